@@ -0,0 +1,236 @@
+// gcc `pkg-config --cflags gtk+-3.0` -o bench bench.c session_store.c project_index.c tree_model.c text_buffer.c font_cache.c recent_catalog.c intern_table.c `pkg-config --libs gtk+-3.0`
+/* Session manager benchmark. Builds windows.c in, to reach its
+ * session routines, and replaces its main().
+ *   run headless:
+ * xvfb-run ./bench [N ...]
+ * GDK_BACKEND=broadway ./bench [N ...]     (with broadwayd running)
+ * For each N, default 16 128 1024, a synthetic master of N sessions,
+ * of varying title and path lengths, is generated in a temporary
+ * directory. Then timed, BENCH_REPEAT times over: session_restore(),
+ * a burst of N lci_session_create(), a focus storm of 10 * N
+ * session_reorder() with a session_flush() each BENCH_FRAME of them,
+ * and lci_session_quit(). Reports p50/p99 latency and RSS.
+ */
+  // nftw()
+#define _GNU_SOURCE
+#define main windows_main
+#include "windows.c"
+#undef main
+
+#include <ftw.h>
+#include <sys/resource.h>
+
+#define BENCH_REPEAT  5
+#define BENCH_FRAME   16
+
+typedef struct _BenchSamples {
+  gint64  *us;
+  int      count, capacity;
+} BenchSamples;
+
+static void
+bench_add(BenchSamples *samples, gint64 us) {
+
+  if (samples->count == samples->capacity) {
+    samples->capacity = (samples->capacity == 0) ? 64 : (samples->capacity * 2);
+    samples->us = realloc(samples->us, samples->capacity * sizeof(gint64));
+  }
+  samples->us[samples->count++] = us;
+}
+
+static int
+bench_compare(const void *a, const void *b) {
+
+  gint64 x = *(const gint64 *)a, y = *(const gint64 *)b;
+  return (x > y) - (x < y);
+}
+
+  // resident set, in KiB
+static long
+bench_rss(void) {
+
+  long pages = 0;
+  FILE *fh = fopen("/proc/self/statm", "r");
+  if (fh != NULL) {
+    if (fscanf(fh, "%*s %ld", &pages) != 1)  pages = 0;
+    fclose(fh);
+  }
+  return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void
+bench_report(int n, const char *phase, BenchSamples *samples) {
+
+  if (samples->count == 0)  return;
+  qsort(samples->us, samples->count, sizeof(gint64), bench_compare);
+  int p99 = (samples->count * 99) / 100;
+  if (p99 >= samples->count)  p99 = samples->count - 1;
+  printf("%6d  %-10s %8d %12" G_GINT64_FORMAT " %12" G_GINT64_FORMAT " %10ld\n",
+         n, phase, samples->count,
+         samples->us[(samples->count / 2)], samples->us[p99], bench_rss());
+  free(samples->us);
+  samples->us = NULL;
+  samples->count = samples->capacity = 0;
+}
+
+  // run whatever restore, create or close left queued
+static void
+bench_drain(void) {
+
+  while (gtk_events_pending())
+    gtk_main_iteration();
+}
+
+  // without a quit, gtk_main_quit() would have no loop to end
+static void
+bench_teardown(void) {
+
+  while (session_top != NULL)
+    session_remove(session_top);
+  journal_reset();
+    // next restore is not to find journal half removed
+  persist_wait();
+  bench_drain();
+}
+
+/* Master and N session files, as a quit would leave them.
+ * Paths and titles vary in length, titles carry quotes and
+ * multi-byte characters.
+ */
+static void
+bench_generate(int n) {
+
+  LCISnapshot *snaps = malloc(n * sizeof(LCISnapshot));
+  char name[256], title[256], path[512];
+
+  for (int idx = 0; idx < n; idx++) {
+    int path_len = (idx * 37) % 200;
+    int title_len = ((idx * 53) % 120) + 1;
+    memset(name, 'p', path_len);
+    name[path_len] = 0;
+    snprintf(path, sizeof(path), "./bench/%d_%s/session.lproj", idx, name);
+    snaps[idx].session_file = intern_string(path);
+    snprintf(title, sizeof(title), "\"%d\" \xc3\xa9", idx);
+    size_t used = strlen(title);
+    while ((int)used < title_len)  title[used++] = 't';
+    title[used] = 0;
+    snaps[idx].title = intern_string(title);
+    snaps[idx].geometry[0] = (idx * 33) % 1200;
+    snaps[idx].geometry[1] = (idx * 33) % 700;
+    snaps[idx].geometry[2] = NEW_WINDOW_WIDTH;
+    snaps[idx].geometry[3] = NEW_WINDOW_HEIGHT;
+    snaps[idx].text = NULL;
+    snaps[idx].text_len = 0;
+    snaps[idx].keep_text = 0;
+  }
+  mkdir("./bench", S_IRWXU);
+  if (store_commit(snaps, n, master_file))
+    puts("ERROR: unable to generate sessions");
+  snapshot_free(snaps, n);
+}
+
+  // 'data' is bench_run()'s quit samples
+static gboolean
+bench_quit(gpointer data) {
+
+  gint64 start = g_get_monotonic_time();
+  lci_session_quit(session_top);
+  bench_add(data, (g_get_monotonic_time() - start));
+  return G_SOURCE_REMOVE;
+}
+
+static void
+bench_run(int n) {
+
+  BenchSamples restore = { 0 }, create = { 0 }, reorder = { 0 }, flush = { 0 };
+  BenchSamples quit = { 0 };
+  GdkEvent *focus = gdk_event_new(GDK_FOCUS_CHANGE);
+
+  for (int rep = 0; rep < BENCH_REPEAT; rep++) {
+    bench_generate(n);
+    gint64 start = g_get_monotonic_time();
+    session_restore(master_file);
+    bench_add(&restore, (g_get_monotonic_time() - start));
+    bench_drain();
+    bench_teardown();
+
+    for (int idx = 0; idx < n; idx++) {
+      start = g_get_monotonic_time();
+      lci_session_create(NULL);
+      bench_add(&create, (g_get_monotonic_time() - start));
+    }
+    bench_drain();
+
+    for (int idx = 0; idx < (10 * n); idx++) {
+      int slot = g_random_int_range(0, nslots);
+      if (session_stack[slot] == NULL)  continue;
+      start = g_get_monotonic_time();
+      session_reorder(session_stack[slot]->main_window, focus,
+                                                session_stack[slot]);
+      bench_add(&reorder, (g_get_monotonic_time() - start));
+      if ((idx % BENCH_FRAME) == (BENCH_FRAME - 1)) {
+        start = g_get_monotonic_time();
+        session_flush_now();
+        bench_add(&flush, (g_get_monotonic_time() - start));
+      }
+    }
+    bench_teardown();
+
+      // quit from inside a main loop, as a user's would
+    bench_generate(n);
+    session_restore(master_file);
+    bench_drain();
+    g_idle_add(bench_quit, &quit);
+    gtk_main();
+    bench_drain();
+    total_created_sessions = 0;
+  }
+  gdk_event_free(focus);
+
+  bench_report(n, "restore", &restore);
+  bench_report(n, "create", &create);
+  bench_report(n, "reorder", &reorder);
+  bench_report(n, "flush", &flush);
+  bench_report(n, "quit", &quit);
+}
+
+static int
+bench_unlink(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+
+  (void)st, (void)flag, (void)ftw;
+  return remove(path);
+}
+
+int
+main(int argc, char *argv[]) {
+
+  if (!gtk_init_check(&argc, &argv)) {
+    puts("ERROR: no display, run under xvfb-run or GDK_BACKEND=broadway");
+    return 1;
+  }
+  char dir[] = "/tmp/lci-bench-XXXXXX";
+  if ((mkdtemp(dir) == NULL) || (chdir(dir) != 0)) {
+    puts("ERROR: unable to make bench directory");
+    return 1;
+  }
+  master_file = session_master();
+  journal_init();
+
+  static const int defaults[] = { 16, 128, 1024 };
+  printf("%6s  %-10s %8s %12s %12s %10s\n",
+         "N", "phase", "samples", "p50 us", "p99 us", "rss KiB");
+  if (argc > 1) {
+    for (int idx = 1; idx < argc; idx++)
+      bench_run(atoi(argv[idx]));
+  } else {
+    for (size_t idx = 0; idx < (sizeof(defaults) / sizeof(int)); idx++)
+      bench_run(defaults[idx]);
+  }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  printf("max rss %ld KiB\n", usage.ru_maxrss);
+
+  if (chdir("/") == 0)
+    nftw(dir, bench_unlink, 16, (FTW_DEPTH | FTW_PHYS));
+  return 0;
+}
@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2021, Dec 13 Steven Abner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Font cache. See font_cache.h.
+ *   Fonts are in 'fonts' by key, description and resolution. One is
+ * resolved by asking Pango for its metrics, then laying out each
+ * printable ASCII character alone for its advance. A font from file
+ * has only its description made, Pango's font loading waits until
+ * something draws with it. 'dirty' says the file no longer matches.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "font_cache.h"
+
+#define FONT_ALIGN(n)  (((n) + 7) & ~(size_t)7)
+
+static GHashTable *fonts;
+static int dirty;
+
+static void
+font_free(gpointer data) {
+
+  LCIFont *font = data;
+  pango_font_description_free(font->description);
+  g_free(font);
+}
+
+static void
+font_table(void) {
+
+  if (fonts == NULL)
+    fonts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, font_free);
+}
+
+  // key's description part, before last '@'
+static LCIFont *
+font_insert(char *key, const LCIFontMetrics *metrics, int resolved) {
+
+  char *name = g_strndup(key, (strrchr(key, '@') - key));
+  LCIFont *font = g_new(LCIFont, 1);
+  font->description = pango_font_description_from_string(name);
+  font->metrics = *metrics;
+  font->resolved = resolved;
+  g_free(name);
+  g_hash_table_insert(fonts, key, font);
+  return font;
+}
+
+static void
+font_resolve(PangoContext *context, PangoFontDescription *description,
+                                    LCIFontMetrics *metrics) {
+
+  PangoFontMetrics *pango = pango_context_get_metrics(context, description,
+                                                               NULL);
+  metrics->ascent = pango_font_metrics_get_ascent(pango);
+  metrics->descent = pango_font_metrics_get_descent(pango);
+  metrics->char_width = pango_font_metrics_get_approximate_char_width(pango);
+  metrics->digit_width = pango_font_metrics_get_approximate_digit_width(pango);
+  pango_font_metrics_unref(pango);
+
+  PangoLayout *layout = pango_layout_new(context);
+  pango_layout_set_font_description(layout, description);
+  for (int idx = 0; idx < FONT_CACHE_GLYPHS; idx++) {
+    char glyph = (char)(FONT_CACHE_FIRST + idx);
+    pango_layout_set_text(layout, &glyph, 1);
+    pango_layout_get_size(layout, &metrics->widths[idx], NULL);
+  }
+  g_object_unref(layout);
+}
+
+/* Font 'name', a Pango description string, as 'context' would draw
+ * it. Resolved on first asking, after that from cache. Valid until
+ * font_cache_invalidate().
+ */
+const LCIFont *
+font_cache_get(PangoContext *context, const char *name) {
+
+  double resolution = pango_cairo_context_get_resolution(context);
+  char *key = g_strdup_printf("%s@%g", name, resolution);
+  font_table();
+  LCIFont *font = g_hash_table_lookup(fonts, key);
+  if (font != NULL) {
+    g_free(key);
+    return font;
+  }
+  LCIFontMetrics metrics;
+  PangoFontDescription *description = pango_font_description_from_string(name);
+  font_resolve(context, description, &metrics);
+  pango_font_description_free(description);
+  dirty = 1;
+  return font_insert(key, &metrics, 1);
+}
+
+  // fonts or their rendering changed, all resolve again
+void
+font_cache_invalidate(void) {
+
+  if ((fonts == NULL) || (g_hash_table_size(fonts) == 0))  return;
+  g_hash_table_remove_all(fonts);
+  dirty = 1;
+}
+
+/* Fills cache from 'path', as written by font_cache_write(). A file
+ * of another Pango is ignored, its fonts may resolve differently.
+ * Return 1 when nothing was loaded.
+ */
+int
+font_cache_load(const char *path) {
+
+  gchar *contents;
+  gsize length;
+  if (!g_file_get_contents(path, &contents, &length, NULL))
+    return 1;
+  LCIFontHeader header = { { 0 } };
+  if (length >= sizeof(header))
+    memcpy(&header, contents, sizeof(header));
+  if ( (memcmp(header.magic, FONT_CACHE_MAGIC, 4) != 0)
+      || (header.version != FONT_CACHE_VERSION)
+      || (header.pango != (uint32_t)pango_version()) ) {
+    g_free(contents);
+    return 1;
+  }
+  font_table();
+  size_t at = sizeof(header);
+  uint32_t loaded = 0;
+  for (; loaded < header.count; loaded++) {
+    LCIFontRecord record;
+    if ((length - at) < sizeof(record))  break;
+    memcpy(&record, (contents + at), sizeof(record));
+    at += sizeof(record);
+    const char *key = contents + at;
+    if ( (record.key_len == 0)
+        || (FONT_ALIGN((size_t)record.key_len) > (length - at))
+        || (key[(record.key_len - 1)] != 0) || (strchr(key, '@') == NULL) )
+      break;
+    at += FONT_ALIGN((size_t)record.key_len);
+    if (!g_hash_table_contains(fonts, key))
+      font_insert(g_strdup(key), &record.metrics, 0);
+  }
+  g_free(contents);
+  return (loaded == 0);
+}
+
+/* Cache as a file's contents, for font_cache_write() off main thread.
+ * Return NULL when file already matches.
+ */
+void *
+font_cache_flatten(size_t *length) {
+
+  if ((!dirty) || (fonts == NULL))  return NULL;
+  size_t size = sizeof(LCIFontHeader);
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, fonts);
+  while (g_hash_table_iter_next(&iter, &key, NULL))
+    size += sizeof(LCIFontRecord) + FONT_ALIGN(strlen(key) + 1);
+
+  char *data = calloc(1, size);
+  LCIFontHeader *header = (LCIFontHeader *)data;
+  memcpy(header->magic, FONT_CACHE_MAGIC, 4);
+  header->version = FONT_CACHE_VERSION;
+  header->count = g_hash_table_size(fonts);
+  header->pango = pango_version();
+  size_t at = sizeof(LCIFontHeader);
+  g_hash_table_iter_init(&iter, fonts);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    LCIFontRecord record = { ((LCIFont *)value)->metrics };
+    record.key_len = strlen(key) + 1;
+    memcpy((data + at), &record, sizeof(record));
+    at += sizeof(record);
+    memcpy((data + at), key, record.key_len);
+    at += FONT_ALIGN((size_t)record.key_len);
+  }
+  dirty = 0;
+  *length = size;
+  return data;
+}
+
+  // a cache, written whole to a temporary and renamed, not synced
+int
+font_cache_write(const char *path, const void *data, size_t length) {
+
+  char *tmp = g_strconcat(path, ".tmp", NULL);
+  FILE *fh = fopen(tmp, "w");
+  int failed = (fh == NULL);
+  if (!failed) {
+    failed = (fwrite(data, length, 1, fh) != 1);
+    failed |= (fclose(fh) != 0);
+    if (failed || (rename(tmp, path) != 0)) {
+      unlink(tmp);
+      failed = 1;
+    }
+  }
+  g_free(tmp);
+  return failed;
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2021, Dec 13 Steven Abner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/* Font cache. Fonts resolved once for the process, with metrics and
+ * advance widths of printable ASCII, shared by every session's text
+ * area. Entries are keyed by font description and resolution, and
+ * dropped only by font_cache_invalidate() on a font or settings
+ * change. The cache saves beside master, FONT_CACHE_SUFFIX, so a
+ * warm start finds its metrics without resolving fonts. Main thread,
+ * but for font_cache_write(). Pango only, no gtk.
+ */
+#ifndef FONT_CACHE_H
+#define FONT_CACHE_H
+
+#include <pango/pangocairo.h>
+
+#define FONT_CACHE_SUFFIX   ".fonts"
+#define FONT_CACHE_MAGIC    "LCIF"
+#define FONT_CACHE_VERSION  1
+#define FONT_CACHE_FIRST    ' '
+#define FONT_CACHE_GLYPHS   ('~' - ' ' + 1)
+
+  // Pango units, PANGO_SCALE to a pixel
+typedef struct _LciFontMetrics {
+  int32_t   ascent, descent;
+  int32_t   char_width, digit_width;
+  int32_t   widths[FONT_CACHE_GLYPHS];  // from FONT_CACHE_FIRST
+} LCIFontMetrics;
+
+typedef struct _LciFont {
+  PangoFontDescription  *description;
+  LCIFontMetrics         metrics;
+  int                    resolved;      // 0 when metrics are from file
+} LCIFont;
+
+  // file: header, then each record followed by its key, padded to 8
+typedef struct _LciFontHeader {
+  char      magic[4];
+  uint32_t  version;
+  uint32_t  count;
+  uint32_t  pango;                      // pango_version() of writer
+} LCIFontHeader;
+
+typedef struct _LciFontRecord {
+  LCIFontMetrics  metrics;
+  uint32_t        key_len;              // counts terminating 0
+  uint32_t        reserved;
+} LCIFontRecord;
+
+const LCIFont *  font_cache_get(PangoContext *, const char *);
+void             font_cache_invalidate(void);
+int              font_cache_load(const char *);
+void *           font_cache_flatten(size_t *);
+int              font_cache_write(const char *, const void *, size_t);
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2021, Dec 13 Steven Abner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Interned strings. See intern_table.h.
+ *   A copy is an LCIIntern with its string following, found from the
+ * string by stepping back over the header. 'table' maps string to
+ * copy. Size classes are powers of 2 from INTERN_SMALLEST, each taking
+ * INTERN_BLOCK at a time, blocks are kept for the life of the process.
+ */
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include "intern_table.h"
+
+#define INTERN_SMALLEST 32
+#define INTERN_CLASSES  8           // 32 .. INTERN_LARGEST
+#define INTERN_BLOCK    (64 * 1024)
+
+typedef struct _LciIntern {
+  union {
+    struct _LciIntern  *next;       // free, on its class's list
+    guint               refs;       // held
+  };
+  int                   class;      // -1 for malloc'ed
+  char                  str[];
+} LCIIntern;
+
+static GMutex intern_lock;
+static GHashTable *table;           // string to LCIIntern
+static LCIIntern *spare[INTERN_CLASSES];
+static size_t carved;               // bytes of blocks, and malloc'ed
+
+static LCIIntern *
+intern_of(const char *str) {
+  return (LCIIntern *)(str - offsetof(LCIIntern, str));
+}
+
+static int
+intern_class(size_t size) {
+
+  int class = 0;
+  while ((class < INTERN_CLASSES) && ((INTERN_SMALLEST << class) < size))
+    class++;
+  return (class < INTERN_CLASSES) ? class : -1;
+}
+
+static LCIIntern *
+intern_alloc(size_t size) {
+
+  int class = intern_class(size);
+  if (class < 0) {
+    carved += size;
+    LCIIntern *copy = malloc(size);
+    copy->class = -1;
+    return copy;
+  }
+  if (spare[class] == NULL) {
+    size_t stride = INTERN_SMALLEST << class;
+    char *block = malloc(INTERN_BLOCK);
+    carved += INTERN_BLOCK;
+    for (size_t at = 0; (at + stride) <= INTERN_BLOCK; at += stride) {
+      LCIIntern *copy = (LCIIntern *)(block + at);
+      copy->next = spare[class];
+      spare[class] = copy;
+    }
+  }
+  LCIIntern *copy = spare[class];
+  spare[class] = copy->next;
+  copy->class = class;
+  return copy;
+}
+
+static void
+intern_free(LCIIntern *copy) {
+
+  if (copy->class < 0) {
+    carved -= offsetof(LCIIntern, str) + strlen(copy->str) + 1;
+    free(copy);
+    return;
+  }
+  copy->next = spare[copy->class];
+  spare[copy->class] = copy;
+}
+
+  // held copy of 'str', NULL for NULL
+const char *
+intern_string(const char *str) {
+
+  if (str == NULL)  return NULL;
+  g_mutex_lock(&intern_lock);
+  if (table == NULL)
+    table = g_hash_table_new(g_str_hash, g_str_equal);
+  LCIIntern *copy = g_hash_table_lookup(table, str);
+  if (copy != NULL) {
+    copy->refs++;
+  } else {
+    size_t length = strlen(str) + 1;
+    copy = intern_alloc(offsetof(LCIIntern, str) + length);
+    copy->refs = 1;
+    memcpy(copy->str, str, length);
+    g_hash_table_insert(table, copy->str, copy);
+  }
+  g_mutex_unlock(&intern_lock);
+  return copy->str;
+}
+
+  // 'str' is interned, held once more
+const char *
+intern_ref(const char *str) {
+
+  if (str == NULL)  return NULL;
+  g_mutex_lock(&intern_lock);
+  intern_of(str)->refs++;
+  g_mutex_unlock(&intern_lock);
+  return str;
+}
+
+void
+intern_release(const char *str) {
+
+  if (str == NULL)  return;
+  g_mutex_lock(&intern_lock);
+  LCIIntern *copy = intern_of(str);
+  if ((--copy->refs) == 0) {
+    g_hash_table_remove(table, copy->str);
+    intern_free(copy);
+  }
+  g_mutex_unlock(&intern_lock);
+}
+
+  // heap taken, blocks whole, whether in use or spare
+size_t
+intern_bytes(void) {
+
+  g_mutex_lock(&intern_lock);
+  size_t bytes = carved;
+  g_mutex_unlock(&intern_lock);
+  return bytes;
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2021, Dec 13 Steven Abner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Interned strings. One refcounted copy of each distinct string, held
+ * by all who use it: sessions' files, project names and titles, the
+ * snapshots of them handed to the persistence worker, documents'
+ * owners. Holding it again is a count, not a copy, so a save or close
+ * makes no string allocations. Copies are carved from blocks in size
+ * classes, a released copy goes back on its class's free list, so
+ * years of opening and closing sessions reuse the same blocks rather
+ * than fragment the heap. Strings over INTERN_LARGEST are malloc'ed.
+ * GLib only, any thread.
+ */
+#ifndef INTERN_TABLE_H
+#define INTERN_TABLE_H
+
+#include <stddef.h>
+
+#define INTERN_LARGEST  4096        // biggest size class, with header
+
+const char *  intern_string(const char *);
+const char *  intern_ref(const char *);
+void          intern_release(const char *);
+size_t        intern_bytes(void);
+
+#endif
@@ -0,0 +1,811 @@
+/*
+ * Copyright (c) 2021, Dec 13 Steven Abner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Project index. See project_index.h.
+ *   An index lives on main thread except while built. Building is
+ * by a thread of its own, 'builder', which hands directories to a
+ * pool of INDEX_THREADS readers and posts index_ready() to main
+ * thread. Readers add entries under 'lock', and watch a directory
+ * before reading it, so what changes meanwhile is in inotify's queue.
+ * Once ready, that queue is read on main loop, an event for what a
+ * reader already found changing nothing.
+ *   Reopen, from PROJECT_INDEX_FILE: every directory is watched and
+ * stat'ed by the pool, those whose mtime differs are read again by
+ * the pool and compared, new directories found get read whole.
+ * Entries a compare finds gone are removed by builder once the pool
+ * is drained, no reader then being under them. Files themselves are
+ * not stat'ed, a file's change never alters the tree.
+ *   A directory moved in once ready is an arrival: builder runs
+ * again for arrivals alone, their trees read by the pool.
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glib-unix.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "project_index.h"
+
+#define INDEX_THREADS   8
+#define INDEX_MAGIC     "LCIX"
+#define INDEX_VERSION   1
+#define INDEX_NO_PARENT 0xffffffffu
+#define INDEX_ALIGN(n)  (((n) + 3) & ~(uint32_t)3)
+#define INDEX_EVENTS    (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO \
+                         | IN_ONLYDIR | IN_DONT_FOLLOW)
+
+struct _LciProjectIndex {
+  char             *root;
+  char             *index_file;
+  LCIIndexEntry    *top;            // project directory
+  GHashTable       *paths;          // path to entry
+  GHashTable       *watches;        // inotify wd to directory entry
+  GMutex            lock;           // 'paths', children, while building
+  GCond             drained;
+  int               pending;        // directories handed to pool
+  GThreadPool      *pool;
+  GThread          *builder;
+  int               inotify_fd;
+  guint             inotify_source;
+  int               ready;
+  int               dirty;          // differs from PROJECT_INDEX_FILE
+  gsize             bytes;          // entries' heap, under 'lock'
+  int               closed;         // closed while building
+  GPtrArray        *gone;           // removed entries, freed when safe
+  GPtrArray        *doomed;         // compares found gone, under 'lock'
+  GPtrArray        *arrivals;       // directories moved in, for builder
+  LCIIndexChanged   changed;
+  gpointer          data;
+};
+
+  // index file, records in pre-order so a parent precedes children
+typedef struct _LciIndexHeader {
+  char      magic[4];
+  uint32_t  version;
+  uint32_t  count;
+} LCIIndexHeader;
+
+typedef struct _LciIndexRecord {
+  uint32_t  parent;               // record number, INDEX_NO_PARENT for top
+  uint32_t  is_dir;
+  int64_t   mtime;
+  uint32_t  name_len;             // name follows, 0 terminated, padded to 4
+} LCIIndexRecord;
+
+static GMutex index_writers_lock;
+static GCond index_writers_done;
+static int index_writers;
+
+  // not project content
+static int
+index_ignored(LCIIndexEntry *dir, const char *name) {
+
+  if ((strcmp(name, ".") == 0) || (strcmp(name, "..") == 0))  return 1;
+  if ( (strcmp(name, ".git") == 0) || (strcmp(name, ".hg") == 0)
+      || (strcmp(name, ".svn") == 0) )
+    return 1;
+    // session's own files
+  if (dir->parent == NULL)
+    return ( (strncmp(name, "session.lproj", 13) == 0)
+            || (strncmp(name, PROJECT_INDEX_FILE, strlen(PROJECT_INDEX_FILE)) == 0) );
+  return 0;
+}
+
+static char *
+index_full_path(LCIProjectIndex *index, LCIIndexEntry *entry) {
+
+  if (entry->path[0] == 0)
+    return g_strdup(index->root);
+  return g_build_filename(index->root, entry->path, NULL);
+}
+
+static LCIIndexEntry *
+index_entry_new(LCIIndexEntry *parent, const char *name, int is_dir) {
+
+  LCIIndexEntry *entry = g_new0(LCIIndexEntry, 1);
+  if (parent == NULL)
+    entry->path = g_strdup("");
+  else if (parent->path[0] == 0)
+    entry->path = g_strdup(name);
+  else
+    entry->path = g_strconcat(parent->path, "/", name, NULL);
+  entry->name = (parent == NULL) ? entry->path
+                                 : (entry->path + (strlen(entry->path) - strlen(name)));
+  entry->parent = parent;
+  entry->children = is_dir ? g_ptr_array_new() : NULL;
+  entry->wd = -1;
+  return entry;
+}
+
+  // an entry's share of heap, its path and its place in 'paths'
+static gsize
+index_entry_bytes(LCIIndexEntry *entry) {
+
+  return sizeof(LCIIndexEntry) + strlen(entry->path) + 1
+         + (3 * sizeof(gpointer))
+         + ((entry->children != NULL) ? sizeof(GPtrArray) : 0);
+}
+
+static void
+index_entry_free(LCIIndexEntry *entry) {
+
+  if (entry->children != NULL)
+    g_ptr_array_free(entry->children, TRUE);
+  g_free(entry->path);
+  g_free(entry);
+}
+
+  // adds 'name' to 'dir', NULL when already there
+static LCIIndexEntry *
+index_add(LCIProjectIndex *index, LCIIndexEntry *dir,
+                                  const char *name, int is_dir) {
+
+  LCIIndexEntry *entry = index_entry_new(dir, name, is_dir);
+  g_mutex_lock(&index->lock);
+  if (g_hash_table_contains(index->paths, entry->path)) {
+    g_mutex_unlock(&index->lock);
+    index_entry_free(entry);
+    return NULL;
+  }
+  g_hash_table_insert(index->paths, entry->path, entry);
+  g_ptr_array_add(dir->children, entry);
+  index->bytes += index_entry_bytes(entry);
+  index->dirty = 1;
+  g_mutex_unlock(&index->lock);
+  return entry;
+}
+
+  // takes 'entry' and what is under it out of index
+static void
+index_remove(LCIProjectIndex *index, LCIIndexEntry *entry) {
+
+  if (entry->children != NULL) {
+    while (entry->children->len != 0)
+      index_remove(index, g_ptr_array_index(entry->children,
+                                            (entry->children->len - 1)));
+  }
+  g_mutex_lock(&index->lock);
+  if (entry->wd >= 0) {
+    if (index->inotify_fd >= 0)
+      inotify_rm_watch(index->inotify_fd, entry->wd);
+    g_hash_table_remove(index->watches, GINT_TO_POINTER(entry->wd));
+    entry->wd = -1;
+  }
+  g_hash_table_remove(index->paths, entry->path);
+  index->bytes -= index_entry_bytes(entry);
+  if (entry->parent != NULL)
+    g_ptr_array_remove_fast(entry->parent->children, entry);
+  g_ptr_array_add(index->gone, entry);
+  index->dirty = 1;
+  g_mutex_unlock(&index->lock);
+}
+
+static void
+index_push(LCIProjectIndex *index, LCIIndexEntry *dir) {
+
+  g_mutex_lock(&index->lock);
+  index->pending++;
+  g_mutex_unlock(&index->lock);
+  g_thread_pool_push(index->pool, dir, NULL);
+}
+
+static void
+index_drain(LCIProjectIndex *index) {
+
+  g_mutex_lock(&index->lock);
+  while (index->pending != 0)
+    g_cond_wait(&index->drained, &index->lock);
+  g_mutex_unlock(&index->lock);
+}
+
+static void
+index_watch(LCIProjectIndex *index, LCIIndexEntry *dir) {
+
+  if ((index->inotify_fd < 0) || (dir->wd >= 0))  return;
+  char *path = index_full_path(index, dir);
+  dir->wd = inotify_add_watch(index->inotify_fd, path, INDEX_EVENTS);
+  g_free(path);
+  if (dir->wd < 0) {
+    static int warned;
+    if ((errno == ENOSPC) && g_atomic_int_compare_and_exchange(&warned, 0, 1))
+      puts("ERROR: project index, out of inotify watches");
+    return;
+  }
+  g_mutex_lock(&index->lock);
+  g_hash_table_insert(index->watches, GINT_TO_POINTER(dir->wd), dir);
+  g_mutex_unlock(&index->lock);
+}
+
+/* Reads 'dir', watched first. New directories found are handed to
+ * pool. With 'compare', entries no longer on disk are put on
+ * 'doomed', for builder to remove.
+ */
+static void
+index_read_dir(LCIProjectIndex *index, LCIIndexEntry *dir, int compare) {
+
+  index_watch(index, dir);
+  char *path = index_full_path(index, dir);
+  DIR *dh = opendir(path);
+  g_free(path);
+  if (dh == NULL)  return;
+  int dfd = dirfd(dh);
+  struct stat st;
+  if (fstat(dfd, &st) == 0)
+    dir->mtime = st.st_mtime;
+
+  GHashTable *seen = compare ? g_hash_table_new(g_str_hash, g_str_equal) : NULL;
+  struct dirent *de;
+  while ((de = readdir(dh)) != NULL) {
+    if (g_atomic_int_get(&index->closed))  break;
+    if (index_ignored(dir, de->d_name))  continue;
+    int is_dir = (de->d_type == DT_DIR);
+    if ( (de->d_type == DT_UNKNOWN)
+        && (fstatat(dfd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0) )
+      is_dir = S_ISDIR(st.st_mode);
+
+    LCIIndexEntry *entry = index_add(index, dir, de->d_name, is_dir);
+    if (seen != NULL) {
+      if (entry == NULL) {
+        char *key = (dir->path[0] == 0) ? g_strdup(de->d_name)
+                       : g_strconcat(dir->path, "/", de->d_name, NULL);
+        g_mutex_lock(&index->lock);
+        entry = g_hash_table_lookup(index->paths, key);
+        g_mutex_unlock(&index->lock);
+        g_free(key);
+        if (entry != NULL)
+          g_hash_table_add(seen, entry->path);
+        continue;
+      }
+      g_hash_table_add(seen, entry->path);
+    }
+    if ((entry != NULL) && is_dir)
+      index_push(index, entry);
+  }
+  closedir(dh);
+
+  if (seen != NULL) {
+      // only this reader adds to 'dir', nothing removes while pool runs
+    g_mutex_lock(&index->lock);
+    for (guint idx = 0; idx < dir->children->len; idx++) {
+      LCIIndexEntry *entry = g_ptr_array_index(dir->children, idx);
+      if (!g_hash_table_contains(seen, entry->path))
+        g_ptr_array_add(index->doomed, entry);
+    }
+    g_mutex_unlock(&index->lock);
+    g_hash_table_destroy(seen);
+  }
+}
+
+  // a stale directory, from reopen's stat, is compared
+static void
+index_read_task(gpointer data, gpointer user_data) {
+
+  LCIProjectIndex *index = user_data;
+  LCIIndexEntry *dir = data;
+  int compare = dir->stale;
+  dir->stale = 0;
+  index_read_dir(index, dir, compare);
+  g_mutex_lock(&index->lock);
+  if ((--index->pending) == 0)
+    g_cond_broadcast(&index->drained);
+  g_mutex_unlock(&index->lock);
+}
+
+  // watched before stat, a change after it is then an event
+static void
+index_stat_task(gpointer data, gpointer user_data) {
+
+  LCIProjectIndex *index = user_data;
+  LCIIndexEntry *dir = data;
+  index_watch(index, dir);
+  struct stat st;
+  char *path = index_full_path(index, dir);
+  dir->stale = ((stat(path, &st) != 0) || (st.st_mtime != dir->mtime));
+  g_free(path);
+}
+
+  // every directory, pre-order
+static void
+index_directories(LCIIndexEntry *dir, GPtrArray *dirs) {
+
+  g_ptr_array_add(dirs, dir);
+  for (guint idx = 0; idx < dir->children->len; idx++) {
+    LCIIndexEntry *entry = g_ptr_array_index(dir->children, idx);
+    if (entry->children != NULL)
+      index_directories(entry, dirs);
+  }
+}
+
+/* Reads PROJECT_INDEX_FILE. Return 1 when absent or not usable,
+ * index then is a lone 'top'.
+ */
+static int
+index_load(LCIProjectIndex *index) {
+
+  gchar *contents;
+  gsize length;
+  if (!g_file_get_contents(index->index_file, &contents, &length, NULL))
+    return 1;
+
+  const LCIIndexHeader *header = (const LCIIndexHeader *)contents;
+  if ( (length < sizeof(LCIIndexHeader))
+      || (memcmp(header->magic, INDEX_MAGIC, 4) != 0)
+      || (header->version != INDEX_VERSION) ) {
+    g_free(contents);
+    return 1;
+  }
+  uint32_t records = header->count;
+    // each at least a record and a padded name, more is a bad count
+  if ( (records == 0) || (records > ((length - sizeof(LCIIndexHeader))
+                  / (sizeof(LCIIndexRecord) + INDEX_ALIGN(1)))) ) {
+    g_free(contents);
+    return 1;
+  }
+  LCIIndexEntry **by_record = g_new(LCIIndexEntry *, records);
+  const char *at = contents + sizeof(LCIIndexHeader);
+  const char *end = contents + length;
+  uint32_t count;
+  for (count = 0; count < records; count++) {
+    LCIIndexRecord record;
+    if ((size_t)(end - at) < sizeof(record))  break;
+    memcpy(&record, at, sizeof(record));
+    at += sizeof(record);
+    if ( (record.name_len == 0)
+        || ((size_t)(end - at) < INDEX_ALIGN(record.name_len))
+        || (at[(record.name_len - 1)] != 0) )
+      break;
+    const char *name = at;
+    at += INDEX_ALIGN(record.name_len);
+
+    LCIIndexEntry *entry;
+    if (count == 0) {
+      if (record.parent != INDEX_NO_PARENT)  break;
+      entry = index->top;
+    } else {
+      if ( (record.parent >= count)
+          || (by_record[record.parent]->children == NULL) )
+        break;
+      entry = index_add(index, by_record[record.parent], name, record.is_dir);
+      if (entry == NULL)  break;
+    }
+    entry->mtime = record.mtime;
+    by_record[count] = entry;
+  }
+  g_free(by_record);
+  g_free(contents);
+  if (count != records) {
+      // partial, start over
+    while (index->top->children->len != 0)
+      index_remove(index, g_ptr_array_index(index->top->children, 0));
+    index->top->mtime = 0;
+    return 1;
+  }
+  index->dirty = 0;
+  return 0;
+}
+
+static void
+index_write_entry(FILE *ih, LCIIndexEntry *entry, uint32_t parent,
+                                                  uint32_t *count) {
+
+  static const char pad[4] = { 0, 0, 0, 0 };
+  LCIIndexRecord record;
+  const char *name = (entry->parent == NULL) ? "." : entry->name;
+  uint32_t self = (*count)++;
+  record.parent = parent;
+  record.is_dir = (entry->children != NULL);
+  record.mtime = entry->mtime;
+  record.name_len = strlen(name) + 1;
+  fwrite(&record, sizeof(record), 1, ih);
+  fwrite(name, 1, record.name_len, ih);
+  fwrite(pad, 1, (INDEX_ALIGN(record.name_len) - record.name_len), ih);
+  if (entry->children == NULL)  return;
+  for (guint idx = 0; idx < entry->children->len; idx++)
+    index_write_entry(ih, g_ptr_array_index(entry->children, idx), self, count);
+}
+
+  // a cache, written whole to a temporary and renamed, not synced
+static void
+index_write(LCIProjectIndex *index) {
+
+  char *tmp = g_strconcat(index->index_file, ".tmp", NULL);
+  FILE *ih = fopen(tmp, "w");
+  if (ih == NULL) {
+    g_free(tmp);
+    return;
+  }
+  LCIIndexHeader header;
+  memcpy(header.magic, INDEX_MAGIC, 4);
+  header.version = INDEX_VERSION;
+  header.count = g_hash_table_size(index->paths);
+  fwrite(&header, sizeof(header), 1, ih);
+  uint32_t count = 0;
+  index_write_entry(ih, index->top, INDEX_NO_PARENT, &count);
+  if ((fclose(ih) == 0) && (count == header.count))
+    rename(tmp, index->index_file);
+  else
+    unlink(tmp);
+  g_free(tmp);
+}
+
+static void
+index_free_gone(LCIProjectIndex *index) {
+
+  for (guint idx = 0; idx < index->gone->len; idx++)
+    index_entry_free(g_ptr_array_index(index->gone, idx));
+  g_ptr_array_set_size(index->gone, 0);
+}
+
+static void
+index_free(LCIProjectIndex *index) {
+
+  index_free_gone(index);
+  GPtrArray *dirs = g_ptr_array_new();
+  index_directories(index->top, dirs);
+  for (guint idx = 0; idx < dirs->len; idx++) {
+    LCIIndexEntry *dir = g_ptr_array_index(dirs, idx);
+    for (guint cdx = 0; cdx < dir->children->len; cdx++) {
+      LCIIndexEntry *entry = g_ptr_array_index(dir->children, cdx);
+      if (entry->children == NULL)  index_entry_free(entry);
+    }
+  }
+  for (guint idx = 0; idx < dirs->len; idx++)
+    index_entry_free(g_ptr_array_index(dirs, idx));
+  g_ptr_array_free(dirs, TRUE);
+  g_ptr_array_free(index->gone, TRUE);
+  g_ptr_array_free(index->doomed, TRUE);
+  g_ptr_array_free(index->arrivals, TRUE);
+  g_hash_table_destroy(index->paths);
+  g_hash_table_destroy(index->watches);
+  g_mutex_clear(&index->lock);
+  g_cond_clear(&index->drained);
+  g_free(index->root);
+  g_free(index->index_file);
+  g_free(index);
+}
+
+static gpointer
+index_write_thread(gpointer data) {
+
+  LCIProjectIndex *index = data;
+  if (index->dirty)
+    index_write(index);
+  index_free(index);
+  g_mutex_lock(&index_writers_lock);
+  if ((--index_writers) == 0)
+    g_cond_broadcast(&index_writers_done);
+  g_mutex_unlock(&index_writers_lock);
+  return NULL;
+}
+
+  // off main thread, written if changed, then freed
+static void
+index_release(LCIProjectIndex *index) {
+
+  g_mutex_lock(&index_writers_lock);
+  index_writers++;
+  g_mutex_unlock(&index_writers_lock);
+  g_thread_unref(g_thread_new("index-write", index_write_thread, index));
+}
+
+static gboolean index_inotify(gint, GIOCondition, gpointer);
+
+static gboolean
+index_ready(gpointer data) {
+
+  LCIProjectIndex *index = data;
+  g_thread_join(index->builder);
+  index->builder = NULL;
+  index_free_gone(index);
+  if (index->closed) {
+      // partial when closed during build, not to be saved
+    if (index->inotify_fd >= 0)  close(index->inotify_fd);
+    index->dirty = 0;
+    index_release(index);
+    return G_SOURCE_REMOVE;
+  }
+  if (index->inotify_fd >= 0)
+    index->inotify_source = g_unix_fd_add(index->inotify_fd, G_IO_IN,
+                                          index_inotify, index);
+  index->ready = 1;
+  if (index->changed != NULL)
+    index->changed(index, NULL, index->data);
+  return G_SOURCE_REMOVE;
+}
+
+static gpointer
+index_build(gpointer data) {
+
+  LCIProjectIndex *index = data;
+  if ((index->inotify_fd < 0) && (!g_atomic_int_get(&index->closed)))
+    index->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+  if (index->arrivals->len != 0) {
+      // moved in, nothing else changed unseen
+    index->pool = g_thread_pool_new(index_read_task, index,
+                                    INDEX_THREADS, TRUE, NULL);
+    for (guint idx = 0; idx < index->arrivals->len; idx++)
+      index_push(index, g_ptr_array_index(index->arrivals, idx));
+    g_ptr_array_set_size(index->arrivals, 0);
+  } else if ( (index->top->children->len != 0)
+             || (index_load(index) == 0) ) {
+      // only what changed since index was written is read
+    GPtrArray *dirs = g_ptr_array_new();
+    index_directories(index->top, dirs);
+    index->pool = g_thread_pool_new(index_stat_task, index,
+                                    INDEX_THREADS, TRUE, NULL);
+    for (guint idx = 0; idx < dirs->len; idx++)
+      g_thread_pool_push(index->pool, g_ptr_array_index(dirs, idx), NULL);
+    g_thread_pool_free(index->pool, FALSE, TRUE);
+
+    index->pool = g_thread_pool_new(index_read_task, index,
+                                    INDEX_THREADS, TRUE, NULL);
+    for (guint idx = 0; idx < dirs->len; idx++) {
+      LCIIndexEntry *dir = g_ptr_array_index(dirs, idx);
+      if (dir->stale)  index_push(index, dir);
+    }
+    g_ptr_array_free(dirs, TRUE);
+  } else {
+    index->pool = g_thread_pool_new(index_read_task, index,
+                                    INDEX_THREADS, TRUE, NULL);
+    index_push(index, index->top);
+  }
+  index_drain(index);
+  g_thread_pool_free(index->pool, FALSE, TRUE);
+  index->pool = NULL;
+
+    // readers done, compares' findings go
+  for (guint idx = 0; idx < index->doomed->len; idx++) {
+    LCIIndexEntry *entry = g_ptr_array_index(index->doomed, idx);
+      // not when already removed with a directory above it
+    g_mutex_lock(&index->lock);
+    int present = (g_hash_table_lookup(index->paths, entry->path) == entry);
+    g_mutex_unlock(&index->lock);
+    if (present)  index_remove(index, entry);
+  }
+  g_ptr_array_set_size(index->doomed, 0);
+  g_idle_add(index_ready, index);
+  return NULL;
+}
+
+static void
+index_start(LCIProjectIndex *index) {
+
+  index->ready = 0;
+  index->builder = g_thread_new("index", index_build, index);
+}
+
+  // events lost, watches dropped, revalidate all
+static void
+index_rebuild(LCIProjectIndex *index) {
+
+    // caller's source, ends on return
+  index->inotify_source = 0;
+  close(index->inotify_fd);
+  index->inotify_fd = -1;
+  GPtrArray *dirs = g_ptr_array_new();
+  index_directories(index->top, dirs);
+  for (guint idx = 0; idx < dirs->len; idx++) {
+    LCIIndexEntry *dir = g_ptr_array_index(dirs, idx);
+    dir->wd = -1;
+      // forces a compare of each
+    dir->mtime = 0;
+  }
+  g_ptr_array_free(dirs, TRUE);
+  g_hash_table_remove_all(index->watches);
+    // read with the rest, by compare
+  g_ptr_array_set_size(index->arrivals, 0);
+    // entries change under builder, users let go of them first
+  index->ready = 0;
+  if (index->changed != NULL)
+    index->changed(index, NULL, index->data);
+  index_start(index);
+}
+
+/* Arrivals are read by builder. Index is not ready meanwhile, users
+ * let go of entries, as on a rebuild, but only arrivals are read.
+ */
+static void
+index_arrivals(LCIProjectIndex *index) {
+
+    // caller's source, ends on return
+  index->inotify_source = 0;
+  index->ready = 0;
+  if (index->changed != NULL)
+    index->changed(index, NULL, index->data);
+  index_start(index);
+}
+
+static void
+index_note_changed(GPtrArray *changed, LCIIndexEntry *dir) {
+
+  for (guint idx = 0; idx < changed->len; idx++)
+    if (g_ptr_array_index(changed, idx) == dir)  return;
+  g_ptr_array_add(changed, dir);
+}
+
+static gboolean
+index_inotify(gint fd, GIOCondition condition, gpointer data) {
+
+  (void)condition;
+  LCIProjectIndex *index = data;
+  char buffer[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+  GPtrArray *changed = g_ptr_array_new();
+  ssize_t got;
+
+  while ((got = read(fd, buffer, sizeof(buffer))) > 0) {
+    for (char *at = buffer; at < (buffer + got); ) {
+      struct inotify_event *event = (struct inotify_event *)at;
+      at += sizeof(struct inotify_event) + event->len;
+      if (event->mask & IN_Q_OVERFLOW) {
+        g_ptr_array_free(changed, TRUE);
+        index_rebuild(index);
+        return G_SOURCE_REMOVE;
+      }
+      LCIIndexEntry *dir = g_hash_table_lookup(index->watches,
+                                               GINT_TO_POINTER(event->wd));
+      if (dir == NULL)  continue;
+      if (event->mask & IN_IGNORED) {
+        g_hash_table_remove(index->watches, GINT_TO_POINTER(event->wd));
+        dir->wd = -1;
+        continue;
+      }
+      if ((event->len == 0) || index_ignored(dir, event->name))  continue;
+
+      if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+        int is_dir = ((event->mask & IN_ISDIR) != 0);
+          // NULL when a reader already found it
+        LCIIndexEntry *entry = index_add(index, dir, event->name, is_dir);
+        if (entry == NULL)  continue;
+        if (is_dir)
+          g_ptr_array_add(index->arrivals, entry);
+      } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        char *key = (dir->path[0] == 0) ? g_strdup(event->name)
+                       : g_strconcat(dir->path, "/", event->name, NULL);
+        LCIIndexEntry *entry = g_hash_table_lookup(index->paths, key);
+        g_free(key);
+        if (entry == NULL)  continue;
+        index_remove(index, entry);
+      }
+      index_note_changed(changed, dir);
+    }
+  }
+
+    // not when gone again with a later event
+  for (guint idx = index->arrivals->len; idx-- != 0; ) {
+    LCIIndexEntry *entry = g_ptr_array_index(index->arrivals, idx);
+    if (g_hash_table_lookup(index->paths, entry->path) != entry)
+      g_ptr_array_remove_index_fast(index->arrivals, idx);
+  }
+
+  for (guint idx = 0; idx < changed->len; idx++) {
+    LCIIndexEntry *dir = g_ptr_array_index(changed, idx);
+      // removed along with a later event
+    if (g_hash_table_lookup(index->paths, dir->path) != dir)  continue;
+      // current as of now, no reread on reopen
+    struct stat st;
+    char *path = index_full_path(index, dir);
+    if (stat(path, &st) == 0)  dir->mtime = st.st_mtime;
+    g_free(path);
+    if (index->changed != NULL)
+      index->changed(index, dir, index->data);
+  }
+  g_ptr_array_free(changed, TRUE);
+  index_free_gone(index);
+  if (index->arrivals->len != 0) {
+    index_arrivals(index);
+    return G_SOURCE_REMOVE;
+  }
+  return G_SOURCE_CONTINUE;
+}
+
+/* Index of 'root', a project directory. Built, or loaded and
+ * brought up to date, off main thread, 'changed' is called once
+ * ready and for each change after.
+ */
+LCIProjectIndex *
+project_index_open(const char *root, LCIIndexChanged changed, gpointer data) {
+
+  LCIProjectIndex *index = g_new0(LCIProjectIndex, 1);
+  index->root = g_strdup(root);
+  index->index_file = g_build_filename(root, PROJECT_INDEX_FILE, NULL);
+  index->paths = g_hash_table_new(g_str_hash, g_str_equal);
+  index->watches = g_hash_table_new(g_direct_hash, g_direct_equal);
+  g_mutex_init(&index->lock);
+  g_cond_init(&index->drained);
+  index->gone = g_ptr_array_new();
+  index->doomed = g_ptr_array_new();
+  index->arrivals = g_ptr_array_new();
+  index->inotify_fd = -1;
+  index->changed = changed;
+  index->data = data;
+  index->top = index_entry_new(NULL, "", 1);
+  g_hash_table_insert(index->paths, index->top->path, index->top);
+  index->bytes = sizeof(LCIProjectIndex) + index_entry_bytes(index->top);
+  index_start(index);
+  return index;
+}
+
+/* No more 'changed'. Index is saved, when changed, and freed off
+ * main thread. One still building is abandoned, unsaved.
+ */
+void
+project_index_close(LCIProjectIndex *index) {
+
+  index->changed = NULL;
+  if (index->builder != NULL) {
+    g_atomic_int_set(&index->closed, 1);
+    return;
+  }
+  if (index->inotify_source != 0)
+    g_source_remove(index->inotify_source);
+  if (index->inotify_fd >= 0)
+    close(index->inotify_fd);
+  index->inotify_fd = -1;
+  index_release(index);
+}
+
+  // NULL while building
+LCIIndexEntry *
+project_index_root(LCIProjectIndex *index) {
+
+  return index->ready ? index->top : NULL;
+}
+
+  // 'path' from project directory, NULL while building
+LCIIndexEntry *
+project_index_lookup(LCIProjectIndex *index, const char *path) {
+
+  return index->ready ? g_hash_table_lookup(index->paths, path) : NULL;
+}
+
+  // entries, project directory not counted
+guint
+project_index_count(LCIProjectIndex *index) {
+
+  return g_hash_table_size(index->paths) - 1;
+}
+
+  // heap held by entries, GLib's table overhead estimated
+gsize
+project_index_bytes(LCIProjectIndex *index) {
+
+  g_mutex_lock(&index->lock);
+  gsize bytes = index->bytes;
+  g_mutex_unlock(&index->lock);
+  return bytes;
+}
+
+  // saving of closed indexes, before exit
+void
+project_index_wait(void) {
+
+  g_mutex_lock(&index_writers_lock);
+  while (index_writers != 0)
+    g_cond_wait(&index_writers_done, &index_writers_lock);
+  g_mutex_unlock(&index_writers_lock);
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2021, Dec 13 Steven Abner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Project index. The files and directories of a named project's
+ * directory, for its tree area. Built off main thread by a pool of
+ * directory readers, then kept current through inotify. Saved
+ * beside the project's session.lproj as PROJECT_INDEX_FILE when
+ * closed, and on reopen only directories whose mtime changed are
+ * read again. GLib only, no gtk.
+ */
+#ifndef PROJECT_INDEX_H
+#define PROJECT_INDEX_H
+
+#include <glib.h>
+
+#define PROJECT_INDEX_FILE "session.lindex"
+
+typedef struct _LciProjectIndex LCIProjectIndex;
+
+typedef struct _LciIndexEntry {
+  char                   *path;     // from project directory, "" for it
+  const char             *name;     // last part of 'path'
+  struct _LciIndexEntry  *parent;
+  GPtrArray              *children; // a directory's, else NULL, unordered
+  gint64                  mtime;    // a directory's, when last read
+  int                     wd;       // inotify watch, -1 for none
+  int                     stale;    // revalidation found it changed
+} LCIIndexEntry;
+
+/* Main thread, after index changed. 'dir' had entries added or
+ * removed, NULL when whole index is new (first build, or rebuild),
+ * or is about to be rebuilt, project_index_root() then being NULL.
+ * Entries are not to be kept past a NULL.
+ */
+typedef void (*LCIIndexChanged)(LCIProjectIndex *, LCIIndexEntry *, gpointer);
+
+LCIProjectIndex *  project_index_open(const char *, LCIIndexChanged, gpointer);
+void               project_index_close(LCIProjectIndex *);
+LCIIndexEntry *    project_index_root(LCIProjectIndex *);
+LCIIndexEntry *    project_index_lookup(LCIProjectIndex *, const char *);
+guint              project_index_count(LCIProjectIndex *);
+gsize              project_index_bytes(LCIProjectIndex *);
+void               project_index_wait(void);
+
+#endif
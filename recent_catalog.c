@@ -0,0 +1,524 @@
+/*
+ * Copyright (c) 2021, Dec 13 Steven Abner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Recent catalog. See recent_catalog.h.
+ *   Entries are in 'entries' by id, NULL once forgotten, ids are not
+ * reused until file is next read. 'grams' maps a trigram, its 3 bytes
+ * in a guint, to ids having it, in id order. 'sorted' is ids by
+ * folded name, made again on first prefix query after a change.
+ * 'hits' counts a query's trigrams per id, 'touched' says which to
+ * clear after.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "recent_catalog.h"
+
+#define RECENT_ALIGN(n)     (((n) + 7) & ~(size_t)7)
+#define RECENT_GRAM(s)      ( ((guint)(guchar)(s)[0] << 16) \
+                            | ((guint)(guchar)(s)[1] << 8) | (guchar)(s)[2] )
+#define RECENT_QUERY_GRAMS  64
+#define RECENT_SEARCH_COST  16        // a search against a list's step
+
+struct _LciRecent {
+  LCIRecentEntry  **entries;
+  guint32           count, capacity;
+  guint             live;
+  GHashTable       *paths;        // path to entry
+  GHashTable       *grams;        // trigram to GArray of guint32 id
+  GArray           *sorted;       // guint32 id, NULL when stale
+  guint16          *hits;         // by id, sized 'capacity'
+  GArray           *touched;
+  int               dirty;        // file no longer matches
+};
+
+typedef struct _LciRecentMatch {
+  LCIRecentEntry  *entry;
+  int              score;
+} LCIRecentMatch;
+
+static void
+recent_entry_free(LCIRecentEntry *entry) {
+
+  g_free(entry->path);
+  g_free(entry->name);
+  g_free(entry->folded);
+  g_free(entry);
+}
+
+static void
+recent_postings_free(gpointer data) {
+  g_array_free(data, TRUE);
+}
+
+  // each trigram of 'folded' once, 'id' added last so kept in order
+static void
+recent_index(LCIRecent *recent, LCIRecentEntry *entry) {
+
+  size_t length = strlen(entry->folded);
+  for (size_t at = 0; (at + 3) <= length; at++) {
+    gpointer gram = GUINT_TO_POINTER(RECENT_GRAM(entry->folded + at));
+    GArray *ids = g_hash_table_lookup(recent->grams, gram);
+    if (ids == NULL) {
+      ids = g_array_new(FALSE, FALSE, sizeof(guint32));
+      g_hash_table_insert(recent->grams, gram, ids);
+    } else if ( (ids->len != 0)
+               && (g_array_index(ids, guint32, (ids->len - 1)) == entry->id) ) {
+      continue;
+    }
+    g_array_append_val(ids, entry->id);
+  }
+}
+
+  // rare, a renamed or forgotten entry, search of each list
+static void
+recent_unindex(LCIRecent *recent, LCIRecentEntry *entry) {
+
+  size_t length = strlen(entry->folded);
+  for (size_t at = 0; (at + 3) <= length; at++) {
+    gpointer gram = GUINT_TO_POINTER(RECENT_GRAM(entry->folded + at));
+    GArray *ids = g_hash_table_lookup(recent->grams, gram);
+    if (ids == NULL)  continue;
+    for (guint idx = 0; idx < ids->len; idx++)
+      if (g_array_index(ids, guint32, idx) == entry->id) {
+        g_array_remove_index(ids, idx);
+        break;
+      }
+    if (ids->len == 0)
+      g_hash_table_remove(recent->grams, gram);
+  }
+}
+
+  // session file's name is the same for all, its directory tells
+static char *
+recent_fold(const char *name, const char *path) {
+
+  char *directory = g_path_get_dirname(path);
+  char *joined = g_strconcat(name, "\n", directory, NULL);
+  char *folded = g_utf8_casefold(joined, -1);
+  g_free(joined);
+  g_free(directory);
+  return folded;
+}
+
+static LCIRecentEntry *
+recent_add(LCIRecent *recent, const char *path, const char *name) {
+
+  if (recent->count == recent->capacity) {
+    recent->capacity = (recent->capacity != 0) ? (recent->capacity * 2) : 256;
+    recent->entries = g_renew(LCIRecentEntry *, recent->entries,
+                                                recent->capacity);
+    recent->hits = g_renew(guint16, recent->hits, recent->capacity);
+    memset((recent->hits + recent->count), 0,
+                       ((recent->capacity - recent->count) * sizeof(guint16)));
+  }
+  LCIRecentEntry *entry = g_new0(LCIRecentEntry, 1);
+  entry->path = g_strdup(path);
+  entry->name = g_strdup(name);
+  entry->folded = recent_fold(name, path);
+  entry->id = recent->count;
+  recent->entries[recent->count++] = entry;
+  recent->live++;
+  g_hash_table_insert(recent->paths, entry->path, entry);
+  recent_index(recent, entry);
+  if (recent->sorted != NULL) {
+    g_array_free(recent->sorted, TRUE);
+    recent->sorted = NULL;
+  }
+  return entry;
+}
+
+static LCIRecent *
+recent_new(void) {
+
+  LCIRecent *recent = g_new0(LCIRecent, 1);
+  recent->paths = g_hash_table_new(g_str_hash, g_str_equal);
+  recent->grams = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                        NULL, recent_postings_free);
+  recent->touched = g_array_new(FALSE, FALSE, sizeof(guint32));
+  return recent;
+}
+
+/* Catalog as last written to 'path', empty when there is none or it
+ * is not a catalog. A record cut short ends reading.
+ */
+LCIRecent *
+recent_open(const char *path) {
+
+  LCIRecent *recent = recent_new();
+  gchar *contents;
+  gsize length;
+  if (!g_file_get_contents(path, &contents, &length, NULL))
+    return recent;
+  LCIRecentHeader header = { { 0 } };
+  if (length >= sizeof(header))
+    memcpy(&header, contents, sizeof(header));
+  if ( (memcmp(header.magic, RECENT_MAGIC, 4) != 0)
+      || (header.version != RECENT_VERSION) ) {
+    g_free(contents);
+    return recent;
+  }
+  size_t at = sizeof(header);
+  for (uint32_t idx = 0; idx < header.count; idx++) {
+    LCIRecentRecord record;
+    if ((length - at) < sizeof(record))  break;
+    memcpy(&record, (contents + at), sizeof(record));
+    at += sizeof(record);
+    const char *path = contents + at;
+    const char *name = path + RECENT_ALIGN((size_t)record.path_len);
+    if ( (record.path_len == 0) || (record.name_len == 0)
+        || ( (RECENT_ALIGN((size_t)record.path_len)
+              + RECENT_ALIGN((size_t)record.name_len)) > (length - at) )
+        || (path[(record.path_len - 1)] != 0)
+        || (name[(record.name_len - 1)] != 0) )
+      break;
+    at += RECENT_ALIGN((size_t)record.path_len)
+          + RECENT_ALIGN((size_t)record.name_len);
+    if (g_hash_table_contains(recent->paths, path))  continue;
+    LCIRecentEntry *entry = recent_add(recent, path, name);
+    entry->last_used = record.last_used;
+    memcpy(entry->geometry, record.geometry, sizeof(entry->geometry));
+  }
+  g_free(contents);
+  return recent;
+}
+
+void
+recent_free(LCIRecent *recent) {
+
+  if (recent == NULL)  return;
+  for (guint32 id = 0; id < recent->count; id++)
+    if (recent->entries[id] != NULL)
+      recent_entry_free(recent->entries[id]);
+  g_free(recent->entries);
+  g_free(recent->hits);
+  g_hash_table_destroy(recent->paths);
+  g_hash_table_destroy(recent->grams);
+  if (recent->sorted != NULL)
+    g_array_free(recent->sorted, TRUE);
+  g_array_free(recent->touched, TRUE);
+  g_free(recent);
+}
+
+/* Session at 'path' in use at 'when', as 'name' with 'geometry'.
+ * Adds it, or updates it, index changing only for a new name.
+ */
+void
+recent_note(LCIRecent *recent, const char *path, const char *name,
+                               const int32_t *geometry, gint64 when) {
+
+  LCIRecentEntry *entry = g_hash_table_lookup(recent->paths, path);
+  if (entry == NULL) {
+    entry = recent_add(recent, path, name);
+  } else if (strcmp(entry->name, name) != 0) {
+    recent_unindex(recent, entry);
+    g_free(entry->name);
+    g_free(entry->folded);
+    entry->name = g_strdup(name);
+    entry->folded = recent_fold(name, path);
+    recent_index(recent, entry);
+    if (recent->sorted != NULL) {
+      g_array_free(recent->sorted, TRUE);
+      recent->sorted = NULL;
+    }
+  }
+  entry->last_used = when;
+  memcpy(entry->geometry, geometry, sizeof(entry->geometry));
+  recent->dirty = 1;
+}
+
+  // a session file found gone
+void
+recent_forget(LCIRecent *recent, const char *path) {
+
+  LCIRecentEntry *entry = g_hash_table_lookup(recent->paths, path);
+  if (entry == NULL)  return;
+  recent_unindex(recent, entry);
+  g_hash_table_remove(recent->paths, path);
+  recent->entries[entry->id] = NULL;
+  recent->live--;
+  if (recent->sorted != NULL) {
+    g_array_free(recent->sorted, TRUE);
+    recent->sorted = NULL;
+  }
+  recent_entry_free(entry);
+  recent->dirty = 1;
+}
+
+guint
+recent_count(LCIRecent *recent) {
+  return recent->live;
+}
+
+static int
+recent_by_name(gconstpointer a, gconstpointer b, gpointer data) {
+
+  LCIRecentEntry **entries = data;
+  return strcmp(entries[*(const guint32 *)a]->folded,
+                entries[*(const guint32 *)b]->folded);
+}
+
+  // better score first, then most recent
+static int
+recent_better(const LCIRecentMatch *ma, const LCIRecentMatch *mb) {
+
+  if (ma->score != mb->score)
+    return (ma->score > mb->score);
+  return (ma->entry->last_used > mb->entry->last_used);
+}
+
+  // 'matches' holds best 'max' so far, in order
+static void
+recent_keep(LCIRecentMatch *matches, int *count, int max,
+                                     LCIRecentEntry *entry, int score) {
+
+  LCIRecentMatch match = { entry, score };
+  int at = *count;
+  if (at == max) {
+    if ((max == 0) || !recent_better(&match, &matches[(max - 1)]))  return;
+    at--;
+  } else {
+    (*count)++;
+  }
+  for (; (at > 0) && recent_better(&match, &matches[(at - 1)]); at--)
+    matches[at] = matches[(at - 1)];
+  matches[at] = match;
+}
+
+  // names starting with 'query', folded, binary search of 'sorted'
+static int
+recent_prefix(LCIRecent *recent, const char *query, LCIRecentMatch *matches,
+                                                    int max) {
+
+  if (recent->sorted == NULL) {
+    recent->sorted = g_array_sized_new(FALSE, FALSE, sizeof(guint32),
+                                                     recent->live);
+    for (guint32 id = 0; id < recent->count; id++)
+      if (recent->entries[id] != NULL)
+        g_array_append_val(recent->sorted, id);
+    g_array_sort_with_data(recent->sorted, recent_by_name, recent->entries);
+  }
+  size_t length = strlen(query);
+  guint lo = 0, hi = recent->sorted->len;
+  while (lo < hi) {
+    guint mid = lo + ((hi - lo) / 2);
+    guint32 id = g_array_index(recent->sorted, guint32, mid);
+    if (strncmp(recent->entries[id]->folded, query, length) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  int count = 0;
+  for (; lo < recent->sorted->len; lo++) {
+    LCIRecentEntry *entry
+              = recent->entries[g_array_index(recent->sorted, guint32, lo)];
+    if (strncmp(entry->folded, query, length) != 0)  break;
+    recent_keep(matches, &count, max, entry,
+                              ((entry->folded[length] == '\n') ? 1 : 0));
+  }
+  return count;
+}
+
+static int
+recent_posted(GArray *ids, guint32 id) {
+
+  guint lo = 0, hi = (ids != NULL) ? ids->len : 0;
+  while (lo < hi) {
+    guint mid = lo + ((hi - lo) / 2);
+    guint32 at = g_array_index(ids, guint32, mid);
+    if (at == id)  return 1;
+    if (at < id)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return 0;
+}
+
+/* An entry is a candidate when it misses at most a quarter of query's
+ * trigrams, a typo costing up to 3, so has one of the rarest quarter
+ * and one: only their lists are walked, candidates then looked up in
+ * the rest. Score is trigrams it has,
+ * more when query is in it whole, at start of name, or is its name.
+ */
+static int
+recent_grams(LCIRecent *recent, const char *query, LCIRecentMatch *matches,
+                                                   int max) {
+
+  GArray *lists[RECENT_QUERY_GRAMS];
+  guint grams[RECENT_QUERY_GRAMS];
+  int ngrams = 0;
+  size_t length = strlen(query);
+  for (size_t at = 0; ((at + 3) <= length) && (ngrams < RECENT_QUERY_GRAMS);
+                                                                 at++) {
+    guint gram = RECENT_GRAM(query + at);
+    int seen = 0;
+    for (int idx = 0; idx < ngrams; idx++)
+      if (grams[idx] == gram)  seen = 1;
+    if (seen)  continue;
+      // rarest first
+    GArray *ids = g_hash_table_lookup(recent->grams, GUINT_TO_POINTER(gram));
+    guint len = (ids != NULL) ? ids->len : 0;
+    int idx = ngrams++;
+    for (; (idx > 0) && (len < ((lists[(idx - 1)] != NULL)
+                                ? lists[(idx - 1)]->len : 0)); idx--) {
+      lists[idx] = lists[(idx - 1)];
+      grams[idx] = grams[(idx - 1)];
+    }
+    lists[idx] = ids;
+    grams[idx] = gram;
+  }
+
+  int missed = (ngrams + 2) / 4;
+  int needed = ngrams - missed;
+  int walked = missed + 1;
+  for (int idx = 0; idx < walked; idx++) {
+    if (lists[idx] == NULL)  continue;
+    for (guint pos = 0; pos < lists[idx]->len; pos++) {
+      guint32 id = g_array_index(lists[idx], guint32, pos);
+      if (recent->hits[id]++ == 0)
+        g_array_append_val(recent->touched, id);
+    }
+  }
+
+    // rest counted for candidates, by search when list is long
+  GArray *touched = recent->touched;
+  for (int idx = walked; idx < ngrams; idx++) {
+    if (lists[idx] == NULL)  continue;
+    if ((touched->len * RECENT_SEARCH_COST) < lists[idx]->len) {
+      for (guint pos = 0; pos < touched->len; pos++) {
+        guint32 id = g_array_index(touched, guint32, pos);
+        recent->hits[id] += recent_posted(lists[idx], id);
+      }
+    } else {
+      for (guint pos = 0; pos < lists[idx]->len; pos++) {
+        guint32 id = g_array_index(lists[idx], guint32, pos);
+        if (recent->hits[id] != 0)  recent->hits[id]++;
+      }
+    }
+  }
+
+  int count = 0;
+  for (guint pos = 0; pos < touched->len; pos++) {
+    guint32 id = g_array_index(touched, guint32, pos);
+    int hits = recent->hits[id];
+    recent->hits[id] = 0;
+    if (hits < needed)  continue;
+    LCIRecentEntry *entry = recent->entries[id];
+    int score = (hits * 100) / ngrams;
+    const char *found = strstr(entry->folded, query);
+    if (found == entry->folded)
+      score += (entry->folded[length] == '\n') ? 300 : 200;
+    else if (found != NULL)
+      score += 100;
+    recent_keep(matches, &count, max, entry, score);
+  }
+  g_array_set_size(touched, 0);
+  return count;
+}
+
+/* Up to 'max' entries matching 'query' into 'found', best first, then
+ * most recent. An empty query is most recent first. Return count.
+ */
+int
+recent_find(LCIRecent *recent, const char *query, LCIRecentEntry **found,
+                                                  int max) {
+
+  if (max <= 0)  return 0;
+  LCIRecentMatch *matches = g_new(LCIRecentMatch, max);
+  char *folded = g_utf8_casefold(query, -1);
+  size_t length = strlen(folded);
+  int count = 0;
+  if (length == 0) {
+    for (guint32 id = 0; id < recent->count; id++)
+      if (recent->entries[id] != NULL)
+        recent_keep(matches, &count, max, recent->entries[id], 0);
+  } else if (length < 3) {
+    count = recent_prefix(recent, folded, matches, max);
+  } else {
+    count = recent_grams(recent, folded, matches, max);
+  }
+  g_free(folded);
+  for (int idx = 0; idx < count; idx++)
+    found[idx] = matches[idx].entry;
+  g_free(matches);
+  return count;
+}
+
+/* Catalog as a file's contents, for recent_write() off main thread.
+ * Return NULL when file already matches.
+ */
+void *
+recent_flatten(LCIRecent *recent, size_t *length) {
+
+  if (!recent->dirty)  return NULL;
+  size_t size = sizeof(LCIRecentHeader);
+  for (guint32 id = 0; id < recent->count; id++) {
+    LCIRecentEntry *entry = recent->entries[id];
+    if (entry == NULL)  continue;
+    size += sizeof(LCIRecentRecord) + RECENT_ALIGN(strlen(entry->path) + 1)
+                                    + RECENT_ALIGN(strlen(entry->name) + 1);
+  }
+  char *data = g_malloc0(size);
+  LCIRecentHeader *header = (LCIRecentHeader *)data;
+  memcpy(header->magic, RECENT_MAGIC, 4);
+  header->version = RECENT_VERSION;
+  header->count = recent->live;
+  size_t at = sizeof(LCIRecentHeader);
+  for (guint32 id = 0; id < recent->count; id++) {
+    LCIRecentEntry *entry = recent->entries[id];
+    if (entry == NULL)  continue;
+    LCIRecentRecord record = { entry->last_used };
+    memcpy(record.geometry, entry->geometry, sizeof(record.geometry));
+    record.path_len = strlen(entry->path) + 1;
+    record.name_len = strlen(entry->name) + 1;
+    memcpy((data + at), &record, sizeof(record));
+    at += sizeof(record);
+    memcpy((data + at), entry->path, record.path_len);
+    at += RECENT_ALIGN((size_t)record.path_len);
+    memcpy((data + at), entry->name, record.name_len);
+    at += RECENT_ALIGN((size_t)record.name_len);
+  }
+  recent->dirty = 0;
+  *length = size;
+  return data;
+}
+
+  // written whole to a temporary and renamed, not synced
+int
+recent_write(const char *path, const void *data, size_t length) {
+
+  char *tmp = g_strconcat(path, ".tmp", NULL);
+  FILE *fh = fopen(tmp, "w");
+  int failed = (fh == NULL);
+  if (!failed) {
+    failed = (fwrite(data, length, 1, fh) != 1);
+    failed |= (fclose(fh) != 0);
+    if (failed || (rename(tmp, path) != 0)) {
+      unlink(tmp);
+      failed = 1;
+    }
+  }
+  g_free(tmp);
+  return failed;
+}
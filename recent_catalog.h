@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2021, Dec 13 Steven Abner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/* Recent catalog. Every project and editor session ever opened, by
+ * its session file, with name, last use and geometry as last saved.
+ * Kept beside master as RECENT_SUFFIX, so open recent and quick switch
+ * never walk directories. Lookup is through a trigram index of each
+ * entry's name and directory, case folded: a query's trigrams pick
+ * candidates, ranked by trigrams shared, so a typo or two still finds
+ * its entry. Queries under 3 characters match name prefixes, by binary
+ * search of names kept sorted. GLib only, main thread, but for
+ * recent_write().
+ */
+#ifndef RECENT_CATALOG_H
+#define RECENT_CATALOG_H
+
+#include <glib.h>
+#include <stdint.h>
+
+#define RECENT_SUFFIX   ".recent"
+#define RECENT_MAGIC    "LCIR"
+#define RECENT_VERSION  1
+
+typedef struct _LciRecent LCIRecent;
+
+typedef struct _LciRecentEntry {
+  char      *path;                // session file, catalog's key
+  char      *name;                // project name or title
+  gint64     last_used;           // seconds, real time
+  int32_t    geometry[4];
+  char      *folded;              // name, newline, directory, case folded
+  guint32    id;                  // place in catalog
+} LCIRecentEntry;
+
+  // file: header, then each record followed by path and name, padded to 8
+typedef struct _LciRecentHeader {
+  char      magic[4];
+  uint32_t  version;
+  uint32_t  count;
+  uint32_t  reserved;
+} LCIRecentHeader;
+
+typedef struct _LciRecentRecord {
+  int64_t   last_used;
+  int32_t   geometry[4];
+  uint32_t  path_len;             // count terminating 0
+  uint32_t  name_len;
+} LCIRecentRecord;
+
+LCIRecent *  recent_open(const char *);
+void         recent_free(LCIRecent *);
+void         recent_note(LCIRecent *, const char *, const char *,
+                                      const int32_t *, gint64);
+void         recent_forget(LCIRecent *, const char *);
+guint        recent_count(LCIRecent *);
+int          recent_find(LCIRecent *, const char *, LCIRecentEntry **, int);
+void *       recent_flatten(LCIRecent *, size_t *);
+int          recent_write(const char *, const void *, size_t);
+
+#endif
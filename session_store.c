@@ -0,0 +1,888 @@
+/*
+ * Copyright (c) 2021, Dec 13 Steven Abner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Session files, without gtk. See session_store.h. */
+  // O_DIRECTORY
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <gio/gio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "intern_table.h"
+#include "session_store.h"
+
+#define STORE_DEFLATE_LEVEL 3       // sessions are saved often, favor speed
+
+static void
+store_write_header(FILE *fh, const char *magic, uint32_t count, uint32_t size) {
+
+  LCIStoreHeader header;
+  memcpy(header.magic, magic, 4);
+  header.version = LCISTORE_VERSION;
+  header.count = count;
+  header.size = size;
+  fwrite(&header, sizeof(header), 1, fh);
+}
+
+static void
+store_write_string(FILE *fh, const char *str, uint32_t length) {
+
+  static const char pad[4] = { 0, 0, 0, 0 };
+  fwrite(&length, sizeof(length), 1, fh);
+  fwrite(str, 1, length, fh);
+  fwrite(pad, 1, (STORE_ALIGN(length) - length), fh);
+}
+
+/* Maps 'path' if it is a binary store of kind 'magic'.
+ * Return 1 when not, file may be absent or of text format.
+ */
+int
+store_map(LCIStoreMap *map, const char *path, const char *magic) {
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)  return 1;
+  struct stat st;
+  if ((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(LCIStoreHeader))) {
+    close(fd);
+    return 1;
+  }
+  void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)  return 1;
+
+  const LCIStoreHeader *header = base;
+  if ( (memcmp(header->magic, magic, 4) != 0)
+      || (header->version == 0) || (header->version > LCISTORE_VERSION)
+      || (header->size != (uint32_t)st.st_size)
+      || (header->count > ((st.st_size - sizeof(LCIStoreHeader)) / 4)) ) {
+    munmap(base, st.st_size);
+    return 1;
+  }
+  map->base = base;
+  map->size = st.st_size;
+  map->offsets = (const uint32_t *)(header + 1);
+  map->count = header->count;
+  map->version = header->version;
+  return 0;
+}
+
+void
+store_unmap(LCIStoreMap *map) {
+  munmap((void *)map->base, map->size);
+}
+
+  // bounds checked pointer to record 'idx', 'fixed' its minimum size
+const void *
+store_record(LCIStoreMap *map, uint32_t idx, size_t fixed) {
+
+  if (idx >= map->count)  return NULL;
+  uint32_t offset = map->offsets[idx];
+  if ((offset & 3) || (offset > map->size) || ((map->size - offset) < fixed))
+    return NULL;
+  return map->base + offset;
+}
+
+  // validates a string of 'length' at 'str' lies within map, terminated
+const char *
+store_string(LCIStoreMap *map, const char *str, uint32_t length) {
+
+  if ( (length == 0)
+      || ((size_t)(str - map->base) > map->size)
+      || ((map->size - (str - map->base)) < length)
+      || (str[(length - 1)] != 0) )
+    return NULL;
+  return str;
+}
+
+/* Payload 'idx' as stored, its record in 'payload', version 1's
+ * made plain. Return its data, NULL when absent, empty or damaged.
+ */
+static const char *
+store_payload_stored(LCIStoreMap *map, uint32_t idx, LCIStorePayload *payload) {
+
+  const char *data;
+  if (map->version == 1) {
+    const LCIStoreTextport *record = store_record(map, idx, sizeof(LCIStoreTextport));
+    if (record == NULL)  return NULL;
+    data = record->data;
+    *payload = (LCIStorePayload){ record->length, record->length, STORE_PLAIN, 0 };
+  } else {
+    const LCIStorePayload *record = store_record(map, idx, sizeof(LCIStorePayload));
+    if (record == NULL)  return NULL;
+    data = record->data;
+    *payload = *record;
+  }
+  if ( (payload->length == 0)
+      || ((map->size - (data - map->base)) < payload->stored)
+      || ((payload->encoding == STORE_PLAIN) && (payload->stored != payload->length))
+      || ((payload->encoding == STORE_DEFLATE)
+          && ((payload->length / STORE_DEFLATE_RATIO) > payload->stored))
+      || ((payload->encoding != STORE_PLAIN) && (payload->encoding != STORE_DEFLATE)) )
+    return NULL;
+  return data;
+}
+
+/* Payload 'idx' as a stream of what its user flattened, 'length'
+ * set, read from the mapping as taken: through a zlib decompressor
+ * when deflated, plain bytes otherwise. Map must outlive it. NULL
+ * when absent, empty or damaged.
+ */
+GInputStream *
+store_payload_stream(LCIStoreMap *map, uint32_t idx, uint32_t *length) {
+
+  LCIStorePayload payload;
+  const char *data = store_payload_stored(map, idx, &payload);
+  *length = 0;
+  if (data == NULL)  return NULL;
+  GInputStream *stream = g_memory_input_stream_new_from_data(data,
+                                                   payload.stored, NULL);
+  if (payload.encoding == STORE_DEFLATE) {
+    GConverter *decompressor = G_CONVERTER(
+                   g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_ZLIB));
+    GInputStream *inflated = g_converter_input_stream_new(stream, decompressor);
+    g_object_unref(decompressor);
+    g_object_unref(stream);
+    stream = inflated;
+  }
+  *length = payload.length;
+  return stream;
+}
+
+  // a stream's decoder reads exactly its length, 1 for more or error
+int
+store_payload_end(GInputStream *stream) {
+
+  char extra;
+  return (g_input_stream_read(stream, &extra, 1, NULL, NULL) != 0);
+}
+
+/* Payload 'idx' as its user flattened it, malloc'ed, 'length' set,
+ * for a user that keeps it whole. NULL when absent, empty or damaged.
+ * Grown as read, from STORE_CHUNK, so a length claimed by a damaged
+ * file is never allocated ahead of data there to fill it.
+ */
+void *
+store_payload(LCIStoreMap *map, uint32_t idx, uint32_t *length) {
+
+  GInputStream *stream = store_payload_stream(map, idx, length);
+  if (stream == NULL)  return NULL;
+  size_t capacity = 0, have = 0;
+  char *out = NULL;
+  int failed = 0;
+  while ((!failed) && (have < *length)) {
+    capacity = (capacity == 0) ? MIN(*length, STORE_CHUNK)
+                               : MIN(((size_t)*length), (capacity * 2));
+    char *grown = realloc(out, capacity);
+    gsize got = 0;
+    failed = (grown == NULL)
+             || (!g_input_stream_read_all(stream, (grown + have),
+                               (capacity - have), &got, NULL, NULL))
+             || (got != (capacity - have));
+    if (grown != NULL)  out = grown;
+    have += got;
+  }
+  if (failed || store_payload_end(stream)) {
+    free(out);
+    out = NULL;
+    *length = 0;
+  }
+  g_object_unref(stream);
+  return out;
+}
+
+  // lets go what 'snaps' hold, array itself stays for reuse
+void
+snapshot_clear(LCISnapshot *snaps, int count) {
+
+  for (int idx = 0; idx < count; idx++) {
+    intern_release(snaps[idx].session_file);
+    intern_release(snaps[idx].title);
+    free(snaps[idx].text);
+  }
+}
+
+void
+snapshot_free(LCISnapshot *snaps, int count) {
+
+  snapshot_clear(snaps, count);
+  free(snaps);
+}
+
+  // bytes store_write_session() writes of 'snap' at most, payloads plain
+uint32_t
+store_session_size(const LCISnapshot *snap) {
+
+  uint32_t sections = (snap->text != NULL) ? LCISTORE_SECTIONS
+                                           : (LCISTORE_GEOMETRY + 1);
+  uint32_t size = sizeof(LCIStoreHeader) + (sections * sizeof(uint32_t))
+                  + sizeof(LCIStoreGeometry) + STORE_ALIGN((strlen(snap->title) + 1));
+  if (snap->text != NULL)
+    size += sizeof(LCIStorePayload) + STORE_ALIGN(snap->text_len);
+  return size;
+}
+
+  // deflated 'data' written out as made, return bytes, 0 on failure
+static uint32_t
+store_deflate(FILE *fh, const char *data, uint32_t length) {
+
+  GConverter *compressor = G_CONVERTER(
+          g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_ZLIB, STORE_DEFLATE_LEVEL));
+  GConverterResult result;
+  char chunk[STORE_CHUNK];
+  uint32_t taken = 0, stored = 0;
+  do {
+    gsize read, written;
+    result = g_converter_convert(compressor, (data + taken), (length - taken),
+                   chunk, sizeof(chunk), G_CONVERTER_INPUT_AT_END,
+                   &read, &written, NULL);
+    if ( (result == G_CONVERTER_ERROR)
+        || (fwrite(chunk, 1, written, fh) != written) ) {
+      result = G_CONVERTER_ERROR;
+      break;
+    }
+    taken += read;
+    stored += written;
+      // stop once larger than it was, not worth it
+  } while ((result == G_CONVERTER_CONVERTED) && (stored < length));
+  g_object_unref(compressor);
+  return ((result == G_CONVERTER_FINISHED) && (stored < length)) ? stored : 0;
+}
+
+/* A payload record at 'offset', return offset following it. Its
+ * header gets written after its data, deflated size being unknown
+ * until then, and a deflate that does not pay is written over plain.
+ */
+static uint32_t
+store_write_payload(FILE *fh, uint32_t offset, const void *data, uint32_t length) {
+
+  static const char pad[4] = { 0, 0, 0, 0 };
+  LCIStorePayload payload = { length, length, STORE_PLAIN, 0 };
+  uint32_t start = offset + sizeof(payload);
+  fseek(fh, start, SEEK_SET);
+  if (length >= STORE_DEFLATE_MIN) {
+    payload.stored = store_deflate(fh, data, length);
+    if (payload.stored != 0)
+      payload.encoding = STORE_DEFLATE;
+    else
+      payload.stored = length;
+  }
+  if (payload.encoding == STORE_PLAIN) {
+    fseek(fh, start, SEEK_SET);
+    fwrite(data, 1, length, fh);
+  }
+  fwrite(pad, 1, (STORE_ALIGN(payload.stored) - payload.stored), fh);
+  fseek(fh, offset, SEEK_SET);
+  fwrite(&payload, sizeof(payload), 1, fh);
+  return start + STORE_ALIGN(payload.stored);
+}
+
+/* Sections in order, header and offsets last once sizes are known.
+ * A 'keep_text' snapshot's textport section comes from the file it
+ * replaces. A plain payload written over a deflate attempt may leave
+ * a tail, cut back to 'size'. Return 1 when that fails.
+ */
+static int
+store_write_session(FILE *sh, LCISnapshot *snap) {
+
+  uint32_t title_len = strlen(snap->title) + 1;
+  uint32_t offsets[LCISTORE_SECTIONS];
+  LCIStoreMap map;
+  LCIStorePayload kept;
+  const char *kept_data = NULL;
+    // copied as stored, not inflated, file is only renamed over later
+  if ( snap->keep_text
+      && (store_map(&map, snap->session_file, LCISTORE_MAGIC_SESSION) == 0)
+      && ((kept_data = store_payload_stored(&map, LCISTORE_TEXTPORT, &kept)) == NULL) )
+    store_unmap(&map);
+  uint32_t sections = ((snap->text != NULL) || (kept_data != NULL))
+                                           ? LCISTORE_SECTIONS
+                                           : (LCISTORE_GEOMETRY + 1);
+  uint32_t size = sizeof(LCIStoreHeader) + (sections * sizeof(uint32_t));
+
+  offsets[LCISTORE_GEOMETRY] = size;
+  fseek(sh, size, SEEK_SET);
+  fwrite(snap->geometry, sizeof(snap->geometry), 1, sh);
+  store_write_string(sh, snap->title, title_len);
+  size += sizeof(LCIStoreGeometry) + STORE_ALIGN(title_len);
+  if (snap->text != NULL) {
+    offsets[LCISTORE_TEXTPORT] = size;
+    size = store_write_payload(sh, size, snap->text, snap->text_len);
+  } else if (kept_data != NULL) {
+    static const char pad[4] = { 0, 0, 0, 0 };
+    offsets[LCISTORE_TEXTPORT] = size;
+    fwrite(&kept, sizeof(kept), 1, sh);
+    fwrite(kept_data, 1, kept.stored, sh);
+    fwrite(pad, 1, (STORE_ALIGN(kept.stored) - kept.stored), sh);
+    size += sizeof(kept) + STORE_ALIGN(kept.stored);
+    store_unmap(&map);
+  }
+  fseek(sh, 0, SEEK_SET);
+  store_write_header(sh, LCISTORE_MAGIC_SESSION, sections, size);
+  fwrite(offsets, sizeof(uint32_t), sections, sh);
+  return (fflush(sh) != 0) || (ftruncate(fileno(sh), size) != 0);
+}
+
+/* 'snaps' is in foreground to background sequence, as is
+ * written. Each record carries its session's position,
+ * 0 == foreground, (count - 1) == bottom-most, so restore can
+ * recreate bottom to top.
+ */
+static void
+store_write_master(FILE *wh, LCISnapshot *snaps, int count) {
+
+  uint32_t size = sizeof(LCIStoreHeader) + (count * sizeof(uint32_t));
+  uint32_t offset = size;
+
+  for (int idx = 0; idx < count; idx++)
+    size += sizeof(LCIStoreMaster)
+            + STORE_ALIGN((strlen(snaps[idx].session_file) + 1));
+  store_write_header(wh, LCISTORE_MAGIC_MASTER, count, size);
+  for (int idx = 0; idx < count; idx++) {
+    fwrite(&offset, sizeof(offset), 1, wh);
+    offset += sizeof(LCIStoreMaster)
+              + STORE_ALIGN((strlen(snaps[idx].session_file) + 1));
+  }
+  for (int idx = 0; idx < count; idx++) {
+    int32_t order = idx;
+    fwrite(&order, sizeof(order), 1, wh);
+    store_write_string(wh, snaps[idx].session_file,
+                           (strlen(snaps[idx].session_file) + 1));
+  }
+}
+
+/* Files of a commit are never written in place. Each is written
+ * to a temporary beside its final name, synced, and renamed over the
+ * real one, master last. Directories holding them are then synced,
+ * a rename being on disk only with its directory. A session file
+ * that cannot be written keeps its old one, the rest of the commit
+ * goes on. A crash before the master's rename leaves the previous
+ * master, whose path lines still point to whole session files.
+ */
+#define COMMIT_SUFFIX ".tmp"
+
+typedef struct _LciCommit {
+  FILE        *fh;
+  const char  *path;              // final location
+  char         tmp[1024];         // path + COMMIT_SUFFIX, then its directory
+} LCICommit;
+
+  // 'make_dir' creates a missing directory, split in 'tmp', 'path' is shared
+static FILE *
+store_commit_open(LCICommit *commit, const char *path, int make_dir) {
+
+  commit->path = path;
+    // a cut short name would write elsewhere
+  if ( (size_t)snprintf(commit->tmp, sizeof(commit->tmp), "%s" COMMIT_SUFFIX, path)
+      >= sizeof(commit->tmp) )
+    return NULL;
+  char *tptr = strrchr(commit->tmp, '/');
+  if (make_dir && (tptr != NULL)) {
+    *tptr = 0;
+    mkdir(commit->tmp, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+    *tptr = '/';
+  }
+  return commit->fh = fopen(commit->tmp, "w");
+}
+
+  // temporary synced and renamed to final name, 1 when left as it was
+static int
+store_commit_close(LCICommit *commit, int failed) {
+
+  if ( (!failed)
+      && ( (fflush(commit->fh) != 0) || ferror(commit->fh)
+          || (fdatasync(fileno(commit->fh)) != 0) ) )
+    failed = 1;
+  if (fclose(commit->fh) != 0)
+    failed = 1;
+  if ((!failed) && (rename(commit->tmp, commit->path) != 0))
+    failed = 1;
+  if (failed)
+    unlink(commit->tmp);
+  return failed;
+}
+
+/* Syncs directories of renamed files, each once however many files
+ * it got. Only the commit's own, not whole filesystems. 'tmp' becomes
+ * its directory, empty for a file that failed.
+ */
+static void
+store_commit_dirs(LCICommit *commits, int ncommits) {
+
+  for (int idx = 0; idx < ncommits; idx++) {
+    char *dir = commits[idx].tmp;
+    if (*dir == 0)  continue;
+    char *slash = strrchr(dir, '/');
+    if (slash == NULL)
+      strcpy(dir, ".");
+    else
+      slash[(slash == dir)] = 0;
+    int sdx = 0;
+    while ((sdx < idx) && (strcmp(commits[sdx].tmp, dir) != 0))  sdx++;
+    if (sdx != idx)  continue;
+    int fd = open(dir, (O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (fd < 0)  continue;
+    fsync(fd);
+    close(fd);
+  }
+}
+
+  // a thread's commit records, grown to its largest commit and kept
+static __thread LCICommit *commit_area;
+static __thread int commit_capacity;
+
+/* Writes 'snaps' sessions' files, and when 'master' is not NULL the
+ * master file listing them. Creates a session file's directory when
+ * missing. Each snapshot's 'failed' is set when its file was not
+ * replaced, master is written regardless. Return 0, or of
+ * STORE_COMMIT_SESSIONS and STORE_COMMIT_MASTER what was not written.
+ */
+int
+store_commit(LCISnapshot *snaps, int count, const char *master) {
+
+  if ((count + 1) > commit_capacity) {
+    free(commit_area);
+    commit_capacity = count + 1;
+    commit_area = malloc(commit_capacity * sizeof(LCICommit));
+  }
+  LCICommit *commits = commit_area;
+  int result = 0;
+
+  for (int idx = 0; idx < count; idx++) {
+    LCICommit *commit = &commits[idx];
+    int failed = (store_commit_open(commit, snaps[idx].session_file, 1) == NULL);
+    if (!failed)
+      failed = store_commit_close(commit,
+                                  store_write_session(commit->fh, &snaps[idx]));
+    if (failed) {
+      commit->tmp[0] = 0;
+      result |= STORE_COMMIT_SESSIONS;
+    }
+    snaps[idx].failed = failed;
+  }
+  store_commit_dirs(commits, count);
+
+  if (master != NULL) {
+    LCICommit *commit = &commits[count];
+    int failed = (store_commit_open(commit, master, 0) == NULL);
+    if (!failed) {
+      store_write_master(commit->fh, snaps, count);
+      failed = store_commit_close(commit, 0);
+    }
+    if (failed)
+      result |= STORE_COMMIT_MASTER;
+    else
+      store_commit_dirs(commit, 1);
+  }
+  return result;
+}
+
+/* Reads a session file's position/size and title into 'entry'.
+ * A binary store is mapped and read in place, the older text format
+ * gets scanned. Restore runs it on a pool of workers. Textport
+ * section streams to 'decoder', its return in 'text', or without
+ * one is copied out to 'stored_text'.
+ */
+void
+store_decode(LCIRestore *entry, LCIStoreDecoder decoder) {
+
+  LCIStoreMap map;
+  int32_t *geometry = entry->stored_geometry;
+
+  entry->stored = 0;
+  entry->stored_size = 0;
+  entry->text = NULL;
+  if (store_map(&map, entry->path, LCISTORE_MAGIC_SESSION) == 0) {
+    entry->stored_size = map.size;
+    const LCIStoreGeometry *record
+                = store_record(&map, LCISTORE_GEOMETRY, sizeof(LCIStoreGeometry));
+    const char *title = (record == NULL) ? NULL
+                : store_string(&map, record->title, record->title_len);
+    if (title != NULL) {
+      geometry[0] = record->pt_x, geometry[1] = record->pt_y;
+      geometry[2] = record->sz_x, geometry[3] = record->sz_y;
+//      pd_x = record->pd_x;
+      entry->stored_title = strdup(title);
+      entry->stored = 1;
+        // get rest of session data
+      if (decoder == NULL) {
+        entry->stored_text = store_payload(&map, LCISTORE_TEXTPORT,
+                                                 &entry->stored_text_len);
+      } else {
+        GInputStream *stream = store_payload_stream(&map, LCISTORE_TEXTPORT,
+                                                    &entry->stored_text_len);
+        if (stream != NULL) {
+          entry->text = decoder(stream, entry->stored_text_len);
+          g_object_unref(stream);
+        }
+      }
+//      lci_treeport_unflatten(&map, entry);
+    }
+    store_unmap(&map);
+    return;
+  }
+    // text format, read for migration
+  char title[128] = { 0 };
+  FILE *sh = fopen(entry->path, "r");
+  if (sh == NULL)  return;
+  int scanned = fscanf(sh, "%d %d %d %d "
+//                           "%d "
+                           "\"%127[^\"]\"\n",
+                           &geometry[0], &geometry[1],
+                           &geometry[2], &geometry[3],
+//                           &pd_x,
+                           title);
+  long taken = ftell(sh);
+  fclose(sh);
+  if (taken > 0)  entry->stored_size = taken;
+  if (scanned >= 4) {
+    entry->stored_title = strdup(title);
+    entry->stored = 1;
+  }
+}
+
+/* Restore list, foreground first. Replay is once, at start up,
+ * and compaction keeps journals short, so linear finds do.
+ */
+static int
+restore_find(LCIRestoreList *list, const char *path) {
+
+  for (int idx = 0; idx < list->count; idx++)
+    if (strcmp(list->entries[idx].path, path) == 0)  return idx;
+  return -1;
+}
+
+  // entry 'idx' to foreground
+static void
+restore_raise(LCIRestoreList *list, int idx) {
+
+  LCIRestore entry = list->entries[idx];
+  memmove(&list->entries[1], &list->entries[0], idx * sizeof(LCIRestore));
+  list->entries[0] = entry;
+}
+
+  // takes 'path'
+void
+restore_append(LCIRestoreList *list, char *path) {
+
+  if (list->count == list->capacity) {
+    list->capacity = (list->capacity == 0) ? 16 : (list->capacity * 2);
+    list->entries = realloc(list->entries,
+                            list->capacity * sizeof(LCIRestore));
+  }
+  LCIRestore *entry = &list->entries[list->count++];
+  entry->path = path;
+  entry->title = NULL;
+  entry->has_geometry = 0;
+  entry->stored = 0;
+  entry->stored_size = 0;
+  entry->stored_title = NULL;
+  entry->stored_text = NULL;
+  entry->stored_text_len = 0;
+  entry->text = NULL;
+}
+
+static void
+restore_remove(LCIRestoreList *list, int idx) {
+
+  free(list->entries[idx].path);
+  free(list->entries[idx].title);
+  list->count--;
+  memmove(&list->entries[idx], &list->entries[(idx + 1)],
+          (list->count - idx) * sizeof(LCIRestore));
+}
+
+  // entries' strings and the list, for those not handing them on
+void
+restore_free(LCIRestoreList *list) {
+
+  for (int idx = 0; idx < list->count; idx++) {
+    free(list->entries[idx].path);
+    free(list->entries[idx].title);
+    free(list->entries[idx].stored_title);
+    free(list->entries[idx].stored_text);
+  }
+  free(list->entries);
+  list->entries = NULL;
+  list->count = list->capacity = 0;
+}
+
+  // FNV-1a
+uint32_t
+journal_check(const char *data, size_t length) {
+
+  uint32_t hash = 2166136261u;
+  while (length--) hash = (hash ^ (uint8_t)*data++) * 16777619u;
+  return hash;
+}
+
+/* Puts a record in 'out', returns its size. 'title' may be NULL,
+ * as 'geometry'. With 'out' NULL only its size.
+ */
+size_t
+journal_record(char *out, uint32_t type, const char *path,
+               const char *title, const int32_t *geometry) {
+
+  uint32_t path_len = strlen(path) + 1;
+  uint32_t title_len = (title == NULL) ? 0 : (strlen(title) + 1);
+  LCIJournalRecord record = { 0 };
+  record.length = JOURNAL_CHECKED + sizeof(uint32_t) + STORE_ALIGN(path_len)
+                                  + sizeof(uint32_t) + STORE_ALIGN(title_len);
+  size_t total = (2 * sizeof(uint32_t)) + record.length;
+  if (out == NULL)  return total;
+
+  record.type = type;
+  if (geometry != NULL)
+    memcpy(record.geometry, geometry, sizeof(record.geometry));
+  memset(out, 0, total);
+  memcpy(out, &record, sizeof(record));
+  char *put = out + sizeof(record);
+  memcpy(put, &path_len, sizeof(uint32_t));
+  memcpy((put + sizeof(uint32_t)), path, path_len);
+  put += sizeof(uint32_t) + STORE_ALIGN(path_len);
+  memcpy(put, &title_len, sizeof(uint32_t));
+  if (title_len != 0)
+    memcpy((put + sizeof(uint32_t)), title, title_len);
+  record.check = journal_check((out + (2 * sizeof(uint32_t))), record.length);
+  memcpy((out + sizeof(uint32_t)), &record.check, sizeof(uint32_t));
+  return total;
+}
+
+/* Replaces journal at 'path' with what store_commit() did not write
+ * of 'snaps': each failed one opened with its title and geometry.
+ * Replay raises on open, so from lowest failed up the others are
+ * raised too, leaving stacking order as 'snaps' have it. Return 1
+ * when not written, 'path' then is as it was.
+ */
+int
+journal_unsaved(const char *path, const LCISnapshot *snaps, int count) {
+
+  LCICommit commit;
+  if (store_commit_open(&commit, path, 0) == NULL)  return 1;
+  LCIJournalHeader header = { JOURNAL_MAGIC, JOURNAL_VERSION };
+  fwrite(&header, sizeof(header), 1, commit.fh);
+  int lowest = count - 1;
+  while ((lowest >= 0) && (!snaps[lowest].failed))  lowest--;
+  int failed = 0;
+  for (int idx = lowest; (idx >= 0) && (!failed); idx--) {
+    const LCISnapshot *snap = &snaps[idx];
+    uint32_t type = snap->failed ? JOURNAL_OPEN : JOURNAL_RAISE;
+    const char *title = snap->failed ? snap->title : NULL;
+    size_t size = journal_record(NULL, type, snap->session_file, title, NULL);
+    char *record = malloc(size);
+    failed = (record == NULL);
+    if (!failed) {
+      journal_record(record, type, snap->session_file, title, snap->geometry);
+      fwrite(record, 1, size, commit.fh);
+      free(record);
+    }
+  }
+  return store_commit_close(&commit, failed);
+}
+
+
+  // a journal string, 'at' advanced past it
+static const char *
+journal_string(const char **at, const char *end) {
+
+  uint32_t length;
+  if ((end - *at) < (ptrdiff_t)sizeof(uint32_t))  return NULL;
+  memcpy(&length, *at, sizeof(uint32_t));
+  *at += sizeof(uint32_t);
+    // STORE_ALIGN() wraps to 0 near UINT32_MAX, raw length checked first
+  size_t room = end - *at;
+  size_t aligned = ((size_t)length + 3) & ~(size_t)3;
+  if ((room < length) || (room < aligned))  return NULL;
+  const char *str = *at;
+  *at += aligned;
+  if (length == 0)  return "";
+  return (str[(length - 1)] == 0) ? str : NULL;
+}
+
+/* Applies a journal's records to 'list', stopping at the first
+ * that fails its check. Returns number of records applied.
+ */
+int
+journal_replay(LCIRestoreList *list, const char *path) {
+
+  int fd = open(path, (O_RDONLY | O_CLOEXEC));
+  if (fd < 0)  return 0;
+  struct stat st;
+  if ((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(LCIJournalHeader))) {
+    close(fd);
+    return 0;
+  }
+  char *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)  return 0;
+  const LCIJournalHeader *header = (const LCIJournalHeader *)base;
+  if ((memcmp(header->magic, JOURNAL_MAGIC, 4) != 0)
+      || (header->version != JOURNAL_VERSION)) {
+    munmap(base, st.st_size);
+    return 0;
+  }
+
+  int applied = 0;
+  const char *at = base + sizeof(LCIJournalHeader);
+  const char *end = base + st.st_size;
+  while ((end - at) >= (ptrdiff_t)sizeof(LCIJournalRecord)) {
+    LCIJournalRecord record;
+    memcpy(&record, at, sizeof(record));
+    const char *checked = at + (2 * sizeof(uint32_t));
+    if ( (record.length < JOURNAL_CHECKED)
+        || ((size_t)(end - checked) < record.length)
+        || (journal_check(checked, record.length) != record.check) )
+      break;
+    const char *rec_end = checked + record.length;
+    const char *str = at + sizeof(record);
+    const char *path = journal_string(&str, rec_end);
+    const char *title = (path == NULL) ? NULL : journal_string(&str, rec_end);
+    at = rec_end;
+    if (title == NULL)  break;
+
+    int idx = restore_find(list, path);
+    switch (record.type) {
+      case JOURNAL_OPEN:
+        if (idx < 0) {
+          restore_append(list, strdup(path));
+          idx = list->count - 1;
+        }
+        free(list->entries[idx].title);
+        list->entries[idx].title = strdup(title);
+        restore_raise(list, idx);
+        idx = 0;
+        /* fall through */
+      case JOURNAL_GEOMETRY:
+        if (idx < 0)  break;
+        list->entries[idx].has_geometry = 1;
+        memcpy(list->entries[idx].geometry, record.geometry,
+                                      sizeof(record.geometry));
+        break;
+      case JOURNAL_RAISE:
+        if (idx >= 0)  restore_raise(list, idx);
+        break;
+      case JOURNAL_CLOSE:
+        if (idx >= 0)  restore_remove(list, idx);
+        break;
+    }
+    applied++;
+  }
+  munmap(base, st.st_size);
+  return applied;
+}
+
+/* Older text 'master', read for migration. Header line of count
+ * and positions, followed by quoted paths. The old writer could
+ * not count past 19 sessions.
+ * Returns number of paths read into allocated 'order' and 'paths',
+ * 'listed' being the count header claimed, -1 on no header.
+ */
+#define TEXT_MASTER_LIMIT 19
+
+static int
+store_read_text(FILE *rh, int **orderp, char ***pathsp, int *listed) {
+
+  char scan_line[1024];
+  int session_count, idx;
+
+  *listed = -1;
+  if ((fscanf(rh, "#%d", &session_count) != 1)
+      || (session_count < 0) || (session_count > TEXT_MASTER_LIMIT))
+    return 0;
+  *listed = session_count;
+  int *order = (*orderp = malloc(session_count * sizeof(int)));
+  char **paths = (*pathsp = malloc(session_count * sizeof(char *)));
+  for (idx = 0; idx < session_count; idx++)
+    if (fscanf(rh, "%d", &order[idx]) != 1)  return 0;
+  fscanf(rh, "%c", &scan_line[0]);
+
+  for (idx = 0; idx < session_count; idx++) {
+    if (fscanf(rh, "\"%1023[^\"]\"\n", scan_line) != 1)
+      break;
+    paths[idx] = strdup(scan_line);
+  }
+  return idx;
+}
+
+/* Reads 'master' into 'list', foreground first. Sessions go by
+ * their position, if master's positions are not a proper sequence,
+ * by listed order. An absent master leaves 'list' as is, a journal
+ * may still hold sessions never saved.
+ * Returns STORE_MASTER_ flags of what was found wrong.
+ */
+int
+store_read_master(const char *master, LCIRestoreList *list) {
+
+  int  *order = NULL;
+  char **paths = NULL;
+  int session_count = 0, found = 0;
+  LCIStoreMap map;
+
+  if (store_map(&map, master, LCISTORE_MAGIC_MASTER) == 0) {
+    order = malloc(map.count * sizeof(int));
+    paths = malloc(map.count * sizeof(char *));
+    for (uint32_t idx = 0; idx < map.count; idx++) {
+      const LCIStoreMaster *record
+                  = store_record(&map, idx, sizeof(LCIStoreMaster));
+      const char *path = (record == NULL) ? NULL
+                  : store_string(&map, record->path, record->path_len);
+      if (path == NULL) {
+        found |= STORE_MASTER_TRUNCATED;
+        break;
+      }
+      order[session_count] = record->order;
+      paths[session_count++] = strdup(path);
+    }
+    store_unmap(&map);
+  } else {
+    FILE *rh = fopen(master, "r");
+    if (rh != NULL) {
+      int listed;
+      found |= STORE_MASTER_TEXT;
+      session_count = store_read_text(rh, &order, &paths, &listed);
+      if (session_count != listed)
+        found |= STORE_MASTER_TRUNCATED;
+      fclose(rh);
+    }
+  }
+
+    // index by position
+  int *by_order = malloc(session_count * sizeof(int));
+  memset(by_order, -1, session_count * sizeof(int));
+  for (int idx = 0; idx < session_count; idx++) {
+    if ((order[idx] < 0) || (order[idx] >= session_count)
+        || (by_order[order[idx]] != -1)) {
+      for (int odx = 0; odx < session_count; odx++) by_order[odx] = odx;
+      found |= STORE_MASTER_ORDER;
+      break;
+    }
+    by_order[order[idx]] = idx;
+  }
+  for (int pos = 0; pos < session_count; pos++)
+    restore_append(list, paths[by_order[pos]]);
+  free(by_order);
+  free(paths);
+  free(order);
+  return found;
+}
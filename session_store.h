@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2021, Dec 13 Steven Abner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Session files, without gtk. Reading and writing of 'master' and
+ * session files, and the geometry journal beside master. Shared by
+ * windows.c and session_tool.c, which checks and repairs them
+ * without a display. libc, and GIO's zlib converters, safe to call
+ * from any thread as long as two calls do not work on the same files.
+ */
+#ifndef SESSION_STORE_H
+#define SESSION_STORE_H
+
+#include <gio/gio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Session store, binary version 2.
+ *   header | offset table | records
+ * Both master and session files share the layout, told apart by
+ * 'magic'. A master has one record per session, a session file
+ * one record per section. Integers are 32 bit host order, records
+ * start 4 byte aligned. Strings are length prefixed, the length
+ * counts a terminating 0, so a mapped string is usable in place.
+ * Files not starting with a magic are the older text format and
+ * still read, they get replaced by binary on next save.
+ *   Sections an interface flattens into are payloads. One of at
+ * least STORE_DEFLATE_MIN is written through a zlib compressor a
+ * STORE_CHUNK at a time, and kept deflated when that came out
+ * smaller. Its input is whole, a snapshot's, flattened on main
+ * thread for a worker to write apart from the session. Reading
+ * hands its decoder a stream over the mapping, inflated as the
+ * decoder takes it, so a payload is only ever in the decoder's own
+ * structures. Version 1 differs only in having payloads plain, as
+ * LCIStoreTextport, and is still read.
+ */
+#define LCISTORE_MAGIC_MASTER   "LCIM"
+#define LCISTORE_MAGIC_SESSION  "LCIS"
+#define LCISTORE_VERSION        2
+#define STORE_DEFLATE_MIN       (4 * 1024)
+#define STORE_CHUNK             (16 * 1024)
+#define STORE_DEFLATE_RATIO     1032        // zlib's most, more is damage
+#define STORE_ALIGN(n)          (((n) + 3) & ~(uint32_t)3)
+
+typedef struct _LciStoreHeader {
+  char      magic[4];
+  uint32_t  version;
+  uint32_t  count;                // entries in offset table
+  uint32_t  size;                 // file size, catches truncation
+} LCIStoreHeader;
+
+  // master record
+typedef struct _LciStoreMaster {
+  int32_t   order;                // position compared to others on screen
+  uint32_t  path_len;
+  char      path[];
+} LCIStoreMaster;
+
+  // session sections, a file without a later section has fewer
+enum {
+  LCISTORE_GEOMETRY,
+  LCISTORE_TEXTPORT,
+//  LCISTORE_TREEPORT,
+  LCISTORE_SECTIONS
+};
+
+typedef struct _LciStoreGeometry {
+  int32_t   pt_x, pt_y, sz_x, sz_y;
+  uint32_t  title_len;
+  char      title[];
+} LCIStoreGeometry;
+
+  // payload section, opaque here, textport's is editor area's view and document
+typedef struct _LciStorePayload {
+  uint32_t  length;               // bytes as its user reads them
+  uint32_t  stored;               // bytes of 'data'
+  uint32_t  encoding;             // STORE_PLAIN or STORE_DEFLATE
+  uint32_t  reserved;
+  char      data[];
+} LCIStorePayload;
+
+enum {
+  STORE_PLAIN,
+  STORE_DEFLATE                   // zlib format
+};
+
+  // version 1's payload
+typedef struct _LciStoreTextport {
+  uint32_t  length;
+  char      data[];
+} LCIStoreTextport;
+
+typedef struct _LciStoreMap {
+  const char      *base;
+  size_t           size;
+  const uint32_t  *offsets;
+  uint32_t         count;
+  uint32_t         version;
+} LCIStoreMap;
+
+/* What gets written of a session. Holds its strings, interned, see
+ * intern_table.h, so writing can happen apart from the session.
+ */
+typedef struct _LciSnapshot {
+  const char *session_file;
+  const char *title;
+  int32_t    geometry[4];         // pt_x, pt_y, sz_x, sz_y
+  void      *text;                // textport section, NULL for none
+  uint32_t   text_len;
+  int        keep_text;           // text NULL, session file's section is kept
+  int        failed;              // set by store_commit(), file not replaced
+} LCISnapshot;
+
+/* A session as read back: master's path, what store_decode()
+ * read of its file, and what journal replay found since.
+ */
+typedef struct _LciRestore {
+  char      *path;
+  char      *title;               // from journal 'open', for no session file
+  int        has_geometry;        // journal geometry
+  int32_t    geometry[4];
+  int        stored;              // session file was read
+  uint32_t   stored_size;         // bytes of it
+  char      *stored_title;
+  int32_t    stored_geometry[4];
+  void      *stored_text;         // textport section, as flattened, no decoder
+  uint32_t   stored_text_len;
+  void      *text;                // textport section as its user decoded it
+} LCIRestore;
+
+  // payload of 'length' taken from stream, return for 'text', see store_decode()
+typedef void *(*LCIStoreDecoder)(GInputStream *, uint32_t);
+
+  // foreground first
+typedef struct _LciRestoreList {
+  LCIRestore  *entries;
+  int          count, capacity;
+} LCIRestoreList;
+
+  // store_read_master() findings, 0 for a proper binary master
+#define STORE_MASTER_TEXT       (1 << 0)    // older format, to migrate
+#define STORE_MASTER_ORDER      (1 << 1)    // positions not a sequence
+#define STORE_MASTER_TRUNCATED  (1 << 2)    // fewer paths than counted
+
+  // store_commit() findings, 0 when every file was replaced
+#define STORE_COMMIT_SESSIONS   (1 << 0)    // some session files kept old
+#define STORE_COMMIT_MASTER     (1 << 1)    // master kept old
+
+/* Geometry journal, records appended beside master between saves.
+ *   header | record ...
+ * A record's check covers what follows it, a torn tail fails its
+ * check and ends replay. Compaction renames the journal aside to
+ * JOURNAL_OLD_SUFFIX until its records are in a new master.
+ */
+#define JOURNAL_SUFFIX          ".journal"
+#define JOURNAL_OLD_SUFFIX      ".journal.old"
+#define JOURNAL_MAGIC           "LCIJ"
+#define JOURNAL_VERSION         1
+
+enum {
+  JOURNAL_OPEN = 1,               // new session, path title geometry
+  JOURNAL_GEOMETRY,               // path geometry
+  JOURNAL_RAISE,                  // path to foreground
+  JOURNAL_CLOSE,                  // path removed
+};
+
+typedef struct _LciJournalHeader {
+  char      magic[4];
+  uint32_t  version;
+} LCIJournalHeader;
+
+  // followed by path and title, as store strings, title may be empty
+typedef struct _LciJournalRecord {
+  uint32_t  length;               // bytes following 'check'
+  uint32_t  check;                // of those bytes
+  uint32_t  type;
+  int32_t   geometry[4];
+} LCIJournalRecord;
+#define JOURNAL_CHECKED (sizeof(LCIJournalRecord) - (2 * sizeof(uint32_t)))
+
+  // mapped reading
+int           store_map(LCIStoreMap *, const char *, const char *);
+void          store_unmap(LCIStoreMap *);
+const void *  store_record(LCIStoreMap *, uint32_t, size_t);
+const char *  store_string(LCIStoreMap *, const char *, uint32_t);
+void *        store_payload(LCIStoreMap *, uint32_t, uint32_t *);
+GInputStream *store_payload_stream(LCIStoreMap *, uint32_t, uint32_t *);
+int           store_payload_end(GInputStream *);
+
+  // writing
+void          snapshot_clear(LCISnapshot *, int);
+void          snapshot_free(LCISnapshot *, int);
+uint32_t      store_session_size(const LCISnapshot *);
+int           store_commit(LCISnapshot *, int, const char *);
+
+  // reading back
+void          store_decode(LCIRestore *, LCIStoreDecoder);
+int           store_read_master(const char *, LCIRestoreList *);
+void          restore_append(LCIRestoreList *, char *);
+void          restore_free(LCIRestoreList *);
+
+  // journal
+uint32_t      journal_check(const char *, size_t);
+size_t        journal_record(char *, uint32_t, const char *,
+                             const char *, const int32_t *);
+int           journal_unsaved(const char *, const LCISnapshot *, int);
+int           journal_replay(LCIRestoreList *, const char *);
+
+#endif
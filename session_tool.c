@@ -0,0 +1,395 @@
+// gcc -O2 `pkg-config --cflags gio-2.0` -o session-tool session_tool.c session_store.c intern_table.c `pkg-config --libs gio-2.0`
+  // nftw(), realpath()
+#define _GNU_SOURCE
+#include <glib.h>
+#include <ctype.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "intern_table.h"
+#include "session_store.h"
+
+/*
+ * Copyright (c) 2021, Dec 13 Steven Abner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Session files checked and repaired without a display.
+ *   session-tool check [-j threads] dir ...
+ *   session-tool fix [-j threads] dir ...
+ * Walks each 'dir' for session.lproj files, masters and session
+ * files being told apart by content, and for journals beside masters.
+ * All work is spread over 'threads' workers, default one per cpu:
+ * the walk per 'dir', then each master, then each session file no
+ * master listed.
+ *   check reports, one line per finding:
+ * a master of older text format, positions not a sequence, listing
+ * cut short, journal records not yet in master, paths listed whose
+ * session file is gone with nothing in journal of it (dangling),
+ * session files of text format or unreadable, and temporaries left
+ * by an interrupted save.
+ *   fix rewrites a master having findings, with journal folded in
+ * and dangling paths dropped, along with its session files, as one
+ * commit, then removes its journals. Text format session files get
+ * migrated, temporaries removed. Unreadable files are left alone.
+ * Not to be run while windows has the master open.
+ *   Relative paths in a master are read against master's directory,
+ * being written from there, a fixed master holds them absolute.
+ * Exit status 0 when nothing is, or is left, wrong, 1 otherwise,
+ * 2 on usage.
+ */
+#define TOOL_FILE       "session.lproj"
+
+enum {
+  TOOL_UNKNOWN,
+  TOOL_MASTER,
+  TOOL_MASTER_TEXT,
+  TOOL_SESSION,
+  TOOL_SESSION_TEXT,
+};
+
+static int tool_fix;
+static GMutex tool_lock;            // tool_masters, tool_sessions, tool_listed
+static GHashTable *tool_masters;    // path set, from master or journal
+static GPtrArray *tool_sessions;
+static GPtrArray *tool_temporaries;
+static GHashTable *tool_listed;     // realpath of session files masters list
+static int tool_counts[3];          // files, findings, fixed
+#define TOOL_FILES     0
+#define TOOL_FINDINGS  1
+#define TOOL_FIXED     2
+
+static void
+tool_report(const char *path, const char *finding, const char *detail) {
+
+  g_atomic_int_inc(&tool_counts[TOOL_FINDINGS]);
+    // one call, lines of workers stay whole
+  if (detail != NULL)
+    printf("%s: %s %s\n", path, finding, detail);
+  else
+    printf("%s: %s\n", path, finding);
+}
+
+static int
+tool_kind(const char *path) {
+
+  char head[4];
+  FILE *fh = fopen(path, "r");
+  if (fh == NULL)  return TOOL_UNKNOWN;
+  size_t got = fread(head, 1, sizeof(head), fh);
+  fclose(fh);
+  if (got == sizeof(head)) {
+    if (memcmp(head, LCISTORE_MAGIC_MASTER, 4) == 0)   return TOOL_MASTER;
+    if (memcmp(head, LCISTORE_MAGIC_SESSION, 4) == 0)  return TOOL_SESSION;
+  }
+  if (got == 0)  return TOOL_UNKNOWN;
+  if (head[0] == '#')  return TOOL_MASTER_TEXT;
+  if (isdigit((unsigned char)head[0]) || (head[0] == '-'))
+    return TOOL_SESSION_TEXT;
+  return TOOL_UNKNOWN;
+}
+
+  // name 'path' ends with, 'suffix' after TOOL_FILE, or NULL
+static const char *
+tool_named(const char *path, const char *suffix) {
+
+  size_t length = strlen(path), tail = strlen(TOOL_FILE) + strlen(suffix);
+  if (length < tail)  return NULL;
+  const char *name = path + (length - tail);
+  if ((name != path) && (name[-1] != '/'))  return NULL;
+  if ( (strncmp(name, TOOL_FILE, strlen(TOOL_FILE)) != 0)
+      || (strcmp((name + strlen(TOOL_FILE)), suffix) != 0) )
+    return NULL;
+  return name;
+}
+
+  // nftw() has no user data, walks of several 'dir' share these
+static int
+tool_visit(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+
+  (void)st, (void)ftw;
+  if (flag != FTW_F)  return 0;
+
+  const char *name;
+  if (tool_named(path, "") != NULL) {
+    int kind = tool_kind(path);
+    g_mutex_lock(&tool_lock);
+    if ((kind == TOOL_MASTER) || (kind == TOOL_MASTER_TEXT))
+      g_hash_table_add(tool_masters, g_strdup(path));
+    else
+      g_ptr_array_add(tool_sessions, g_strdup(path));
+    g_mutex_unlock(&tool_lock);
+  } else if ( ((name = tool_named(path, JOURNAL_SUFFIX)) != NULL)
+             || ((name = tool_named(path, JOURNAL_OLD_SUFFIX)) != NULL) ) {
+      // journal of a master that may never have been saved
+    char *master = g_strndup(path, ((name - path) + strlen(TOOL_FILE)));
+    g_mutex_lock(&tool_lock);
+    if (!g_hash_table_add(tool_masters, master))
+      g_free(master);
+    g_mutex_unlock(&tool_lock);
+  } else if (tool_named(path, ".tmp") != NULL) {
+    g_mutex_lock(&tool_lock);
+    g_ptr_array_add(tool_temporaries, g_strdup(path));
+    g_mutex_unlock(&tool_lock);
+  }
+  return 0;
+}
+
+static void
+tool_walk(gpointer data, gpointer user_data) {
+
+  (void)user_data;
+  if (nftw(data, tool_visit, 16, FTW_PHYS) != 0)
+    tool_report(data, "unable to walk", NULL);
+}
+
+  // a master's path, as file system finds it
+static char *
+tool_resolve(const char *master, const char *path) {
+
+  if (path[0] == '/')
+    return g_strdup(path);
+  char real[PATH_MAX];
+  char *dir = g_path_get_dirname(master);
+  char *resolved = g_build_filename(((realpath(dir, real) != NULL) ? real : dir),
+                                    path, NULL);
+  g_free(dir);
+  return resolved;
+}
+
+static void
+tool_note_listed(const char *path) {
+
+  char real[PATH_MAX];
+  if (realpath(path, real) == NULL)  return;
+  g_mutex_lock(&tool_lock);
+  g_hash_table_add(tool_listed, g_strdup(real));
+  g_mutex_unlock(&tool_lock);
+}
+
+/* Checks a master, with its journals and session files listed.
+ * With 'tool_fix' a master found wanting is written anew.
+ */
+static void
+tool_master(gpointer data, gpointer user_data) {
+
+  (void)user_data;
+  const char *master = data;
+  char journal_file[PATH_MAX + 16], journal_old[PATH_MAX + 16];
+  snprintf(journal_file, sizeof(journal_file), "%s" JOURNAL_SUFFIX, master);
+  snprintf(journal_old, sizeof(journal_old), "%s" JOURNAL_OLD_SUFFIX, master);
+  g_atomic_int_inc(&tool_counts[TOOL_FILES]);
+
+  int findings = 0;
+  LCIRestoreList list = { NULL, 0, 0 };
+  if (access(master, F_OK) != 0) {
+    tool_report(master, "missing, journal only", NULL);
+    findings++;
+  }
+  int found = store_read_master(master, &list);
+  if (found & STORE_MASTER_TEXT) {
+    tool_report(master, "text format", NULL);
+    findings++;
+  }
+  if (found & STORE_MASTER_ORDER) {
+    tool_report(master, "positions not a sequence", NULL);
+    findings++;
+  }
+  if (found & STORE_MASTER_TRUNCATED) {
+    tool_report(master, "listing cut short", NULL);
+    findings++;
+  }
+  int replayed = journal_replay(&list, journal_old)
+                 + journal_replay(&list, journal_file);
+  if (replayed != 0) {
+    char detail[32];
+    snprintf(detail, sizeof(detail), "%d", replayed);
+    tool_report(master, "journal records", detail);
+    findings++;
+  }
+
+    // what a restore would bring up, in order
+  LCISnapshot *snaps = malloc(((list.count != 0) ? list.count : 1)
+                                                  * sizeof(LCISnapshot));
+  int nsnaps = 0;
+  for (int idx = 0; idx < list.count; idx++) {
+    LCIRestore *entry = &list.entries[idx];
+    char *listed = entry->path;
+    entry->path = tool_resolve(master, listed);
+    tool_note_listed(entry->path);
+    store_decode(entry, NULL);
+
+    const int32_t *geometry;
+    const char *title;
+    if (entry->stored) {
+      title = entry->stored_title;
+      geometry = entry->has_geometry ? entry->geometry : entry->stored_geometry;
+      if (tool_kind(entry->path) == TOOL_SESSION_TEXT) {
+        tool_report(entry->path, "text format", NULL);
+        findings++;
+      }
+    } else if ((entry->title != NULL) && entry->has_geometry) {
+      title = entry->title;
+      geometry = entry->geometry;
+    } else {
+      tool_report(master, "dangling", listed);
+      findings++;
+      free(listed);
+      continue;
+    }
+    free(listed);
+    snaps[nsnaps].session_file = intern_string(entry->path);
+    snaps[nsnaps].title = intern_string(title);
+    memcpy(snaps[nsnaps].geometry, geometry, sizeof(snaps[nsnaps].geometry));
+      // editor state goes back as it was read
+    snaps[nsnaps].text = entry->stored_text;
+    snaps[nsnaps].text_len = entry->stored_text_len;
+    snaps[nsnaps].keep_text = 0;
+    entry->stored_text = NULL;
+    nsnaps++;
+  }
+
+  if (tool_fix && (findings != 0)) {
+    if (store_commit(snaps, nsnaps, master)) {
+      tool_report(master, "unable to rewrite", NULL);
+    } else {
+      unlink(journal_file);
+      unlink(journal_old);
+      g_atomic_int_add(&tool_counts[TOOL_FIXED], findings);
+    }
+  }
+  snapshot_free(snaps, nsnaps);
+  restore_free(&list);
+}
+
+  // a session file no master lists
+static void
+tool_session(gpointer data, gpointer user_data) {
+
+  (void)user_data;
+  const char *path = data;
+  g_atomic_int_inc(&tool_counts[TOOL_FILES]);
+
+  int kind = tool_kind(path);
+  LCIRestore entry = { (char *)path };
+  if (kind != TOOL_UNKNOWN)
+    store_decode(&entry, NULL);
+  if (!entry.stored) {
+    tool_report(path, "unreadable", NULL);
+    return;
+  }
+  if (kind == TOOL_SESSION_TEXT) {
+    tool_report(path, "text format", NULL);
+    if (tool_fix) {
+      LCISnapshot *snap = malloc(sizeof(LCISnapshot));
+      snap->session_file = intern_string(path);
+      snap->title = intern_string(entry.stored_title);
+      memcpy(snap->geometry, entry.stored_geometry, sizeof(snap->geometry));
+      snap->text = NULL;
+      snap->text_len = 0;
+      snap->keep_text = 0;
+      if (store_commit(snap, 1, NULL))
+        tool_report(path, "unable to rewrite", NULL);
+      else
+        g_atomic_int_inc(&tool_counts[TOOL_FIXED]);
+      snapshot_free(snap, 1);
+    }
+  }
+  free(entry.stored_title);
+  free(entry.stored_text);
+}
+
+static void
+tool_run(GFunc func, gpointer *items, guint count, int threads) {
+
+  GThreadPool *pool = g_thread_pool_new(func, NULL, threads, TRUE, NULL);
+  for (guint idx = 0; idx < count; idx++)
+    g_thread_pool_push(pool, items[idx], NULL);
+  g_thread_pool_free(pool, FALSE, TRUE);
+}
+
+static int
+tool_usage(void) {
+
+  fprintf(stderr, "usage: session-tool check|fix [-j threads] dir ...\n");
+  return 2;
+}
+
+int
+main(int argc, char *argv[]) {
+
+  if (argc < 2)  return tool_usage();
+  if (strcmp(argv[1], "fix") == 0)
+    tool_fix = 1;
+  else if (strcmp(argv[1], "check") != 0)
+    return tool_usage();
+
+  int threads = g_get_num_processors();
+  int first = 2;
+  if ((first < argc) && (strncmp(argv[first], "-j", 2) == 0)) {
+    const char *value = (argv[first][2] != 0) ? &argv[first][2]
+                                              : argv[++first];
+    if ((value == NULL) || ((threads = atoi(value)) < 1))
+      return tool_usage();
+    first++;
+  }
+  if (first >= argc)  return tool_usage();
+
+  tool_masters = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  tool_sessions = g_ptr_array_new_with_free_func(g_free);
+  tool_temporaries = g_ptr_array_new_with_free_func(g_free);
+  tool_listed = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+  tool_run(tool_walk, (gpointer *)&argv[first], (argc - first), threads);
+
+    // masters first, they may rewrite session files they list
+  guint nmasters;
+  gpointer *masters = g_hash_table_get_keys_as_array(tool_masters, &nmasters);
+  tool_run(tool_master, masters, nmasters, threads);
+  g_free(masters);
+
+  GPtrArray *unlisted = g_ptr_array_new();
+  for (guint idx = 0; idx < tool_sessions->len; idx++) {
+    char real[PATH_MAX];
+    const char *path = g_ptr_array_index(tool_sessions, idx);
+    if ( (realpath(path, real) == NULL)
+        || (!g_hash_table_contains(tool_listed, real)) )
+      g_ptr_array_add(unlisted, (gpointer)path);
+  }
+  tool_run(tool_session, unlisted->pdata, unlisted->len, threads);
+  g_ptr_array_free(unlisted, TRUE);
+
+  for (guint idx = 0; idx < tool_temporaries->len; idx++) {
+    const char *path = g_ptr_array_index(tool_temporaries, idx);
+    tool_report(path, "temporary of interrupted save", NULL);
+    if (tool_fix && (unlink(path) == 0))
+      tool_counts[TOOL_FIXED]++;
+  }
+
+  printf("%d files, %d findings, %d fixed\n", tool_counts[TOOL_FILES],
+         tool_counts[TOOL_FINDINGS], tool_counts[TOOL_FIXED]);
+  g_hash_table_destroy(tool_masters);
+  g_ptr_array_free(tool_sessions, TRUE);
+  g_ptr_array_free(tool_temporaries, TRUE);
+  g_hash_table_destroy(tool_listed);
+  return (tool_counts[TOOL_FINDINGS] > tool_counts[TOOL_FIXED]);
+}
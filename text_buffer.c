@@ -0,0 +1,534 @@
+/*
+ * Copyright (c) 2021, Dec 13 Steven Abner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Text buffer. See text_buffer.h. */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "text_buffer.h"
+
+#define TEXT_ALIGN(n)   (((n) + 7) & ~(size_t)7)
+#define TEXT_SUFFIX     ".tmp"
+
+  // node of treap, ordered by position, heap ordered by 'priority'
+typedef struct _LciPiece {
+  struct _LciPiece  *left, *right;
+  size_t             start;
+  size_t             length;
+  size_t             size;        // bytes of subtree
+  uint32_t           priority;
+  uint32_t           source;
+} LCIPiece;
+
+struct _LciTextBuffer {
+  char        *path;              // NULL for an unnamed buffer
+  const char  *original;          // mapped, NULL when empty
+  size_t       original_size;
+  int64_t      mtime_ns;
+  uint64_t     inode;
+  char        *typed;             // append only
+  size_t       typed_len, typed_cap;
+  LCIPiece    *root;
+  uint32_t     seed;
+};
+
+static size_t
+piece_size(LCIPiece *piece) {
+  return (piece != NULL) ? piece->size : 0;
+}
+
+static void
+piece_update(LCIPiece *piece) {
+  piece->size = piece_size(piece->left) + piece->length + piece_size(piece->right);
+}
+
+  // xorshift, priorities need only be spread
+static uint32_t
+piece_priority(LCITextBuffer *buffer) {
+
+  uint32_t x = buffer->seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return buffer->seed = x;
+}
+
+static LCIPiece *
+piece_new(LCITextBuffer *buffer, uint32_t source, size_t start, size_t length) {
+
+  LCIPiece *piece = malloc(sizeof(LCIPiece));
+  piece->left = piece->right = NULL;
+  piece->start = start;
+  piece->length = piece->size = length;
+  piece->priority = piece_priority(buffer);
+  piece->source = source;
+  return piece;
+}
+
+static void
+piece_free(LCIPiece *piece) {
+
+  if (piece == NULL)  return;
+  piece_free(piece->left);
+  piece_free(piece->right);
+  free(piece);
+}
+
+static const char *
+piece_text(LCITextBuffer *buffer, LCIPiece *piece) {
+
+  return ((piece->source == TEXT_ORIGINAL) ? buffer->original : buffer->typed)
+         + piece->start;
+}
+
+/* Splits 'piece' into the first 'pos' bytes, 'left', and the rest.
+ * A piece holding 'pos' is cut in two, its second half taking the
+ * same priority keeps both sides heap ordered.
+ */
+static void
+piece_split(LCITextBuffer *buffer, LCIPiece *piece, size_t pos,
+                                   LCIPiece **left, LCIPiece **right) {
+
+  if (piece == NULL) {
+    *left = *right = NULL;
+    return;
+  }
+  size_t before = piece_size(piece->left);
+  if (pos <= before) {
+    piece_split(buffer, piece->left, pos, left, &piece->left);
+    piece_update(piece);
+    *right = piece;
+  } else if (pos >= (before + piece->length)) {
+    piece_split(buffer, piece->right, (pos - before - piece->length),
+                                      &piece->right, right);
+    piece_update(piece);
+    *left = piece;
+  } else {
+    size_t cut = pos - before;
+    LCIPiece *rest = piece_new(buffer, piece->source, (piece->start + cut),
+                                                      (piece->length - cut));
+    rest->priority = piece->priority;
+    rest->right = piece->right;
+    piece->right = NULL;
+    piece->length = cut;
+    piece_update(rest);
+    piece_update(piece);
+    *left = piece;
+    *right = rest;
+  }
+}
+
+static LCIPiece *
+piece_merge(LCIPiece *left, LCIPiece *right) {
+
+  if (left == NULL)  return right;
+  if (right == NULL)  return left;
+  if (left->priority > right->priority) {
+    left->right = piece_merge(left->right, right);
+    piece_update(left);
+    return left;
+  }
+  right->left = piece_merge(left, right->left);
+  piece_update(right);
+  return right;
+}
+
+static size_t
+piece_read(LCITextBuffer *buffer, LCIPiece *piece, size_t pos,
+                                  char *out, size_t length) {
+
+  size_t done = 0;
+  while ((piece != NULL) && (length != 0)) {
+    size_t before = piece_size(piece->left);
+    if (pos < before) {
+      size_t got = piece_read(buffer, piece->left, pos, out, length);
+      out += got, length -= got, done += got;
+      pos = before;
+      if (length == 0)  break;
+    }
+    if (pos < (before + piece->length)) {
+      size_t offset = pos - before;
+      size_t count = piece->length - offset;
+      if (count > length)  count = length;
+      memcpy(out, (piece_text(buffer, piece) + offset), count);
+      out += count, length -= count, done += count;
+      pos += count;
+    }
+    pos -= before + piece->length;
+    piece = piece->right;
+  }
+  return done;
+}
+
+static int
+piece_write(LCITextBuffer *buffer, LCIPiece *piece, FILE *fh) {
+
+  if (piece == NULL)  return 0;
+  if (piece_write(buffer, piece->left, fh))  return 1;
+  if ( (piece->length != 0)
+      && (fwrite(piece_text(buffer, piece), piece->length, 1, fh) != 1) )
+    return 1;
+  return piece_write(buffer, piece->right, fh);
+}
+
+static void
+piece_count(LCIPiece *piece, uint32_t *count, size_t *typed) {
+
+  if (piece == NULL)  return;
+  piece_count(piece->left, count, typed);
+  (*count)++;
+  if (piece->source == TEXT_TYPED)
+    *typed += piece->length;
+  piece_count(piece->right, count, typed);
+}
+
+  // pieces in order, typed spans packed at 'text'
+static void
+piece_flatten(LCITextBuffer *buffer, LCIPiece *piece, LCITextPiece **at,
+                                      char *text, size_t *packed) {
+
+  if (piece == NULL)  return;
+  piece_flatten(buffer, piece->left, at, text, packed);
+  LCITextPiece *out = (*at)++;
+  out->source = piece->source;
+  out->reserved = 0;
+  out->length = piece->length;
+  if (piece->source == TEXT_TYPED) {
+    memcpy((text + *packed), piece_text(buffer, piece), piece->length);
+    out->start = *packed;
+    *packed += piece->length;
+  } else {
+    out->start = piece->start;
+  }
+  piece_flatten(buffer, piece->right, at, text, packed);
+}
+
+/* Maps 'path' as buffer's original. Return 1 on failure, buffer
+ * then unchanged.
+ */
+static int
+text_map(LCITextBuffer *buffer, const char *path) {
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)  return 1;
+  struct stat st;
+  if ((fstat(fd, &st) != 0) || (!S_ISREG(st.st_mode))) {
+    close(fd);
+    return 1;
+  }
+  const char *original = NULL;
+  if (st.st_size != 0) {
+    original = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (original == MAP_FAILED) {
+      close(fd);
+      return 1;
+    }
+  }
+  close(fd);
+  if (buffer->original != NULL)
+    munmap((void *)buffer->original, buffer->original_size);
+  buffer->original = original;
+  buffer->original_size = st.st_size;
+  buffer->mtime_ns = ((int64_t)st.st_mtim.tv_sec * 1000000000) + st.st_mtim.tv_nsec;
+  buffer->inode = st.st_ino;
+  return 0;
+}
+
+  // whole original, no typed text
+static void
+text_pristine(LCITextBuffer *buffer) {
+
+  piece_free(buffer->root);
+  buffer->root = NULL;
+  buffer->typed_len = 0;
+  if (buffer->original_size != 0)
+    buffer->root = piece_new(buffer, TEXT_ORIGINAL, 0, buffer->original_size);
+}
+
+/* Buffer of file 'path', or empty and unnamed for NULL. File is
+ * mapped, not read. Return NULL when 'path' cannot be opened.
+ */
+LCITextBuffer *
+text_buffer_open(const char *path) {
+
+  LCITextBuffer *buffer = calloc(1, sizeof(LCITextBuffer));
+  buffer->seed = 2463534242u;
+  if (path != NULL) {
+    if (text_map(buffer, path)) {
+      free(buffer);
+      return NULL;
+    }
+    buffer->path = strdup(path);
+  }
+  text_pristine(buffer);
+  return buffer;
+}
+
+void
+text_buffer_free(LCITextBuffer *buffer) {
+
+  if (buffer == NULL)  return;
+  piece_free(buffer->root);
+  if (buffer->original != NULL)
+    munmap((void *)buffer->original, buffer->original_size);
+  free(buffer->typed);
+  free(buffer->path);
+  free(buffer);
+}
+
+const char *
+text_buffer_path(LCITextBuffer *buffer) {
+  return buffer->path;
+}
+
+size_t
+text_buffer_length(LCITextBuffer *buffer) {
+  return piece_size(buffer->root);
+}
+
+  // heap held, original's mapped size into 'mapped' when not NULL
+size_t
+text_buffer_bytes(LCITextBuffer *buffer, size_t *mapped) {
+
+  uint32_t npieces = 0;
+  size_t typed = 0;
+  piece_count(buffer->root, &npieces, &typed);
+  if (mapped != NULL)
+    *mapped = (buffer->original != NULL) ? buffer->original_size : 0;
+  return sizeof(LCITextBuffer) + buffer->typed_cap
+         + ((size_t)npieces * sizeof(LCIPiece))
+         + ((buffer->path != NULL) ? (strlen(buffer->path) + 1) : 0);
+}
+
+  // copies up to 'length' bytes from 'pos', return count copied
+size_t
+text_buffer_read(LCITextBuffer *buffer, size_t pos, char *out, size_t length) {
+
+  if (pos >= piece_size(buffer->root))  return 0;
+  return piece_read(buffer, buffer->root, pos, out, length);
+}
+
+/* Inserts 'length' bytes of 'text' at 'pos'. Typing at the end of
+ * the last typed piece grows it rather than adding pieces.
+ * Return 1 when 'pos' is past end or out of memory.
+ */
+int
+text_buffer_insert(LCITextBuffer *buffer, size_t pos, const char *text,
+                                                      size_t length) {
+
+  if (pos > piece_size(buffer->root))  return 1;
+  if (length == 0)  return 0;
+  if ((buffer->typed_len + length) > buffer->typed_cap) {
+    size_t capacity = (buffer->typed_cap == 0) ? 4096 : (buffer->typed_cap * 2);
+    while (capacity < (buffer->typed_len + length))  capacity *= 2;
+    char *typed = realloc(buffer->typed, capacity);
+    if (typed == NULL)  return 1;
+    buffer->typed = typed;
+    buffer->typed_cap = capacity;
+  }
+  size_t start = buffer->typed_len;
+  memcpy((buffer->typed + start), text, length);
+  buffer->typed_len += length;
+
+  LCIPiece *left, *right;
+  piece_split(buffer, buffer->root, pos, &left, &right);
+  LCIPiece *last = left;
+  while ((last != NULL) && (last->right != NULL))  last = last->right;
+  if ( (last != NULL) && (last->source == TEXT_TYPED)
+      && ((last->start + last->length) == start) ) {
+    for (LCIPiece *piece = left; piece != NULL; piece = piece->right)
+      piece->size += length;
+    last->length += length;
+  } else {
+    left = piece_merge(left, piece_new(buffer, TEXT_TYPED, start, length));
+  }
+  buffer->root = piece_merge(left, right);
+  return 0;
+}
+
+  // removes 'length' bytes at 'pos', return 1 when past end
+int
+text_buffer_delete(LCITextBuffer *buffer, size_t pos, size_t length) {
+
+  size_t size = piece_size(buffer->root);
+  if ((pos > size) || (length > (size - pos)))  return 1;
+  if (length == 0)  return 0;
+  LCIPiece *left, *middle, *right;
+  piece_split(buffer, buffer->root, pos, &left, &right);
+  piece_split(buffer, right, length, &middle, &right);
+  piece_free(middle);
+  buffer->root = piece_merge(left, right);
+  return 0;
+}
+
+  // differs from original
+int
+text_buffer_modified(LCITextBuffer *buffer) {
+
+  LCIPiece *root = buffer->root;
+  if (root == NULL)  return (buffer->original_size != 0);
+  return (root->left != NULL) || (root->right != NULL)
+         || (root->source != TEXT_ORIGINAL) || (root->start != 0)
+         || (root->length != buffer->original_size);
+}
+
+/* Writes buffer over its file, by temporary and rename, then maps
+ * what was written as new original. Return 1 on failure, unnamed
+ * buffers included.
+ */
+int
+text_buffer_save(LCITextBuffer *buffer) {
+
+  if (buffer->path == NULL)  return 1;
+  size_t tlen = strlen(buffer->path) + sizeof(TEXT_SUFFIX);
+  char *tmp = malloc(tlen);
+  snprintf(tmp, tlen, "%s" TEXT_SUFFIX, buffer->path);
+  FILE *fh = fopen(tmp, "w");
+  if (fh == NULL) {
+    free(tmp);
+    return 1;
+  }
+  int failed = piece_write(buffer, buffer->root, fh);
+  if ((fflush(fh) != 0) || (fsync(fileno(fh)) != 0))  failed = 1;
+  if (fclose(fh) != 0)  failed = 1;
+    // prior mapping stays valid, it holds the replaced inode
+  if ((!failed) && (rename(tmp, buffer->path) == 0)) {
+    if (text_map(buffer, buffer->path) == 0) {
+      text_pristine(buffer);
+      free(tmp);
+      return 0;
+    }
+  }
+  unlink(tmp);
+  free(tmp);
+  return 1;
+}
+
+/* Buffer as a session file record, after 'room' bytes left for
+ * its caller, a multiple of 8. *length set to its size, 'room'
+ * included. Typed text no piece refers to any longer is left out.
+ * Return NULL when it would not fit a record.
+ */
+void *
+text_buffer_flatten(LCITextBuffer *buffer, size_t room, uint32_t *length) {
+
+  uint32_t npieces = 0;
+  size_t typed = 0;
+  piece_count(buffer->root, &npieces, &typed);
+  size_t path_len = (buffer->path != NULL) ? (strlen(buffer->path) + 1) : 1;
+  size_t size = room + sizeof(LCITextRecord) + TEXT_ALIGN(path_len)
+                + ((size_t)npieces * sizeof(LCITextPiece)) + typed;
+  if (size > UINT32_MAX)  return NULL;
+
+  char *record = calloc(1, size);
+  if (record == NULL)  return NULL;
+  LCITextRecord *header = (LCITextRecord *)(record + room);
+  header->size = buffer->original_size;
+  header->mtime_ns = buffer->mtime_ns;
+  header->inode = buffer->inode;
+  header->typed = typed;
+  header->npieces = npieces;
+  header->path_len = path_len;
+  char *path = (char *)(header + 1);
+  if (buffer->path != NULL)
+    memcpy(path, buffer->path, path_len);
+  LCITextPiece *pieces = (LCITextPiece *)(path + TEXT_ALIGN(path_len));
+  size_t packed = 0;
+  piece_flatten(buffer, buffer->root, &pieces, (char *)(pieces + npieces), &packed);
+  *length = size;
+  return record;
+}
+
+/* Buffer back from a record of text_buffer_flatten(), of 'length',
+ * taken from 'source' by 'read' as it goes: typed text is read
+ * straight into the buffer's own, the record is never held whole.
+ * When its original changed since, edits cannot apply: *stale is
+ * set and buffer is the file as it is now, rest of record unread.
+ * Return NULL for a record not valid, or an original no longer
+ * opened.
+ */
+LCITextBuffer *
+text_buffer_unflatten(LCITextRead read, void *source, uint32_t length,
+                                                      int *stale) {
+
+  LCITextRecord header;
+  *stale = 0;
+  if ((length < sizeof(LCITextRecord)) || read(source, &header, sizeof(header)))
+    return NULL;
+  size_t path_size = TEXT_ALIGN((size_t)header.path_len);
+  size_t pieces_at = sizeof(LCITextRecord) + path_size;
+  if ( (header.path_len == 0) || (pieces_at > length)
+      || (header.npieces > ((length - pieces_at) / sizeof(LCITextPiece)))
+      || (header.typed != (length - pieces_at
+                           - ((size_t)header.npieces * sizeof(LCITextPiece)))) )
+    return NULL;
+
+  char *path = malloc(path_size);
+  if ( (path == NULL) || read(source, path, path_size)
+      || (path[(header.path_len - 1)] != 0) ) {
+    free(path);
+    return NULL;
+  }
+  LCITextBuffer *buffer = text_buffer_open((path[0] != 0) ? path : NULL);
+  int named = (path[0] != 0);
+  free(path);
+  if (buffer == NULL)  return NULL;
+  if ( (buffer->original_size != header.size)
+      || (named && ( (buffer->mtime_ns != header.mtime_ns)
+                    || (buffer->inode != header.inode) )) ) {
+    *stale = 1;
+    return buffer;
+  }
+
+    // pieces come first, checked against typed text's size to be
+  piece_free(buffer->root);
+  buffer->root = NULL;
+  for (uint32_t idx = 0; idx < header.npieces; idx++) {
+    LCITextPiece piece;
+    int invalid = read(source, &piece, sizeof(piece))
+                  || (piece.source > TEXT_TYPED);
+    if (!invalid) {
+      size_t limit = (piece.source == TEXT_ORIGINAL) ? buffer->original_size
+                                                     : header.typed;
+      invalid = (piece.start > limit) || (piece.length > (limit - piece.start));
+    }
+    if (invalid) {
+      text_buffer_free(buffer);
+      return NULL;
+    }
+    buffer->root = piece_merge(buffer->root, piece_new(buffer, piece.source,
+                                                  piece.start, piece.length));
+  }
+  if (header.typed != 0) {
+    buffer->typed = malloc(header.typed);
+    if ((buffer->typed == NULL) || read(source, buffer->typed, header.typed)) {
+      text_buffer_free(buffer);
+      return NULL;
+    }
+    buffer->typed_len = buffer->typed_cap = header.typed;
+  }
+  return buffer;
+}
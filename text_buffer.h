@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2021, Dec 13 Steven Abner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/* Text buffer, the editor area's document. A piece table: text is
+ * a sequence of pieces, each a span of either the original file,
+ * mapped read only, or of an append only buffer of what was typed.
+ * Pieces are kept in a treap by position, so an edit is a split and
+ * a merge, O(log n) in pieces, and opening a file of any size is one
+ * mmap. Only libc, a buffer is not to be shared between threads.
+ *   Saving as text replaces the original, written whole. Flattening
+ * for a session file writes only pieces and typed text, with the
+ * original's size, mtime and inode to know it unchanged on return.
+ *   A mapped original changed on disk by others while open is
+ * undefined, as with any mmap, truncation can fault on read.
+ */
+#ifndef TEXT_BUFFER_H
+#define TEXT_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct _LciTextBuffer LCITextBuffer;
+
+  // flattened buffer, followed by path, pieces, typed text
+typedef struct _LciTextRecord {
+  uint64_t  size;                 // original's, edits apply only to it
+  int64_t   mtime_ns;
+  uint64_t  inode;
+  uint64_t  typed;                // bytes of typed text at end
+  uint32_t  npieces;
+  uint32_t  path_len;             // counts terminating 0, padded to 8
+} LCITextRecord;
+
+typedef struct _LciTextPiece {
+  uint32_t  source;               // TEXT_ORIGINAL or TEXT_TYPED
+  uint32_t  reserved;
+  uint64_t  start;
+  uint64_t  length;
+} LCITextPiece;
+
+enum {
+  TEXT_ORIGINAL,
+  TEXT_TYPED
+};
+
+  // next 'length' bytes of a flattened record into 'out', 1 when short
+typedef int (*LCITextRead)(void *, void *, size_t);
+
+LCITextBuffer *  text_buffer_open(const char *);
+void             text_buffer_free(LCITextBuffer *);
+const char *     text_buffer_path(LCITextBuffer *);
+size_t           text_buffer_length(LCITextBuffer *);
+size_t           text_buffer_bytes(LCITextBuffer *, size_t *);
+size_t           text_buffer_read(LCITextBuffer *, size_t, char *, size_t);
+int              text_buffer_insert(LCITextBuffer *, size_t, const char *, size_t);
+int              text_buffer_delete(LCITextBuffer *, size_t, size_t);
+int              text_buffer_modified(LCITextBuffer *);
+int              text_buffer_save(LCITextBuffer *);
+void *           text_buffer_flatten(LCITextBuffer *, size_t, uint32_t *);
+LCITextBuffer *  text_buffer_unflatten(LCITextRead, void *, uint32_t, int *);
+
+#endif
@@ -0,0 +1,577 @@
+/*
+ * Copyright (c) 2021, Dec 13 Steven Abner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/* Tree model. See tree_model.h.
+ *   Rows are LCITreeRow in 'rows', rows[0] standing for project
+ * directory. A directory's children, once made, are a run of rows
+ * sorted directories first, then by name as a file manager would.
+ * A row's 'count' is what views were told of its children, kept for
+ * unmade runs too, so has-child is right without making them. Runs
+ * of collapsed rows go back to 'holes' for reuse. Iterators carry a
+ * row number, they last until next change or unload.
+ */
+#include <string.h>
+#include "tree_model.h"
+
+#define TREE_NONE   G_MAXUINT32
+#define TREE_NODE(iter)  GPOINTER_TO_UINT((iter)->user_data)
+
+typedef struct _LciTreeRow {
+  LCIIndexEntry  *entry;
+  guint32         parent;         // row of level above, 0 for top level
+  guint32         first;          // children's run, 0 until made
+  guint32         count;          // children, as views know them
+  guint32         capacity;       // of run
+} LCITreeRow;
+
+typedef struct _LciTreeHole {
+  guint32         first;
+  guint32         capacity;
+} LCITreeHole;
+
+struct _LCITreeModel {
+  GObject         parent_instance;
+  gint            stamp;
+  LCITreeRow     *rows;
+  guint32         nrows, capacity;
+  GArray         *holes;          // runs given back, reused first fit
+};
+
+typedef struct _LciTreeKey {
+  LCIIndexEntry  *entry;
+  char           *key;
+} LCITreeKey;
+
+static void tree_model_iface_init(GtkTreeModelIface *);
+
+G_DEFINE_TYPE_WITH_CODE(LCITreeModel, lci_tree_model, G_TYPE_OBJECT,
+        G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL, tree_model_iface_init))
+
+static guint32
+tree_children(LCIIndexEntry *entry) {
+
+  return (entry->children != NULL) ? entry->children->len : 0;
+}
+
+static char *
+tree_key(LCIIndexEntry *entry) {
+
+  return g_utf8_collate_key_for_filename(entry->name, -1);
+}
+
+  // directories first, then by name
+static int
+tree_key_compare(const void *a, const void *b) {
+
+  const LCITreeKey *ka = a, *kb = b;
+  int a_dir = (ka->entry->children != NULL);
+  int b_dir = (kb->entry->children != NULL);
+  if (a_dir != b_dir)  return (b_dir - a_dir);
+  return strcmp(ka->key, kb->key);
+}
+
+static guint32
+tree_run_alloc(LCITreeModel *model, guint32 capacity) {
+
+  for (guint idx = 0; idx < model->holes->len; idx++) {
+    LCITreeHole *hole = &g_array_index(model->holes, LCITreeHole, idx);
+    if (hole->capacity < capacity)  continue;
+    guint32 first = hole->first;
+    hole->first += capacity;
+    hole->capacity -= capacity;
+    if (hole->capacity == 0)
+      g_array_remove_index_fast(model->holes, idx);
+    return first;
+  }
+  if ((model->nrows + capacity) > model->capacity) {
+    model->capacity = MAX((model->capacity * 2), (model->nrows + capacity));
+    model->rows = g_renew(LCITreeRow, model->rows, model->capacity);
+  }
+  guint32 first = model->nrows;
+  model->nrows += capacity;
+  return first;
+}
+
+static void
+tree_run_free(LCITreeModel *model, guint32 first, guint32 capacity) {
+
+  LCITreeHole hole = { first, capacity };
+  g_array_append_val(model->holes, hole);
+    // holes ending the array shorten it instead
+  for (guint idx = 0; idx < model->holes->len; ) {
+    LCITreeHole *at = &g_array_index(model->holes, LCITreeHole, idx);
+    if ((at->first + at->capacity) != model->nrows) {
+      idx++;
+      continue;
+    }
+    model->nrows = at->first;
+    g_array_remove_index_fast(model->holes, idx);
+    idx = 0;
+  }
+}
+
+  // children of 'node' moved, point them at it
+static void
+tree_reparent(LCITreeModel *model, guint32 node) {
+
+  LCITreeRow *row = &model->rows[node];
+  for (guint32 idx = 0; idx < row->count; idx++)
+    model->rows[(row->first + idx)].parent = node;
+}
+
+static void
+tree_unload(LCITreeModel *model, guint32 node) {
+
+  guint32 first = model->rows[node].first;
+  if (first == 0)  return;
+  for (guint32 idx = 0; idx < model->rows[node].count; idx++)
+    tree_unload(model, (first + idx));
+  tree_run_free(model, first, model->rows[node].capacity);
+  model->rows[node].first = 0;
+  model->rows[node].capacity = 0;
+}
+
+static void
+tree_load(LCITreeModel *model, guint32 node) {
+
+  LCITreeRow *row = &model->rows[node];
+  if ((row->first != 0) || (row->entry == NULL))  return;
+  guint32 count = tree_children(row->entry);
+  row->count = count;
+  if (count == 0)  return;
+
+  LCITreeKey *keys = g_new(LCITreeKey, count);
+  for (guint32 idx = 0; idx < count; idx++) {
+    keys[idx].entry = g_ptr_array_index(row->entry->children, idx);
+    keys[idx].key = tree_key(keys[idx].entry);
+  }
+  qsort(keys, count, sizeof(LCITreeKey), tree_key_compare);
+
+  guint32 first = tree_run_alloc(model, count);
+  for (guint32 idx = 0; idx < count; idx++) {
+    LCITreeRow *child = &model->rows[(first + idx)];
+    child->entry = keys[idx].entry;
+    child->parent = node;
+    child->first = 0;
+    child->count = tree_children(keys[idx].entry);
+    child->capacity = 0;
+    g_free(keys[idx].key);
+  }
+  g_free(keys);
+  row = &model->rows[node];
+  row->first = first;
+  row->capacity = count;
+}
+
+static gboolean
+tree_iter_set(LCITreeModel *model, GtkTreeIter *iter, guint32 node) {
+
+  iter->stamp = model->stamp;
+  iter->user_data = GUINT_TO_POINTER(node);
+  return TRUE;
+}
+
+static GtkTreePath *
+tree_path(LCITreeModel *model, guint32 node) {
+
+  GtkTreePath *path = gtk_tree_path_new();
+  while (node != 0) {
+    guint32 parent = model->rows[node].parent;
+    gtk_tree_path_prepend_index(path, (node - model->rows[parent].first));
+    node = parent;
+  }
+  return path;
+}
+
+  // row of 'dir', TREE_NONE if a view could not know it
+static guint32
+tree_find(LCITreeModel *model, LCIIndexEntry *dir) {
+
+  if (model->rows[0].entry == NULL)  return TREE_NONE;
+  if (dir->parent == NULL)  return 0;
+  guint32 node = tree_find(model, dir->parent);
+  if ((node == TREE_NONE) || (model->rows[node].first == 0))
+    return TREE_NONE;
+  LCITreeRow *row = &model->rows[node];
+  for (guint32 idx = 0; idx < row->count; idx++)
+    if (model->rows[(row->first + idx)].entry == dir)
+      return (row->first + idx);
+  return TREE_NONE;
+}
+
+  // where 'entry' sorts among children of 'node'
+static guint32
+tree_position(LCITreeModel *model, guint32 node, LCIIndexEntry *entry) {
+
+  LCITreeKey key = { entry, tree_key(entry) };
+  guint32 low = 0, high = model->rows[node].count;
+  while (low < high) {
+    guint32 mid = (low + high) / 2;
+    LCITreeKey at;
+    at.entry = model->rows[(model->rows[node].first + mid)].entry;
+    at.key = tree_key(at.entry);
+    if (tree_key_compare(&key, &at) > 0)
+      low = mid + 1;
+    else
+      high = mid;
+    g_free(at.key);
+  }
+  g_free(key.key);
+  return low;
+}
+
+static void
+tree_emit(LCITreeModel *model, guint32 node, guint signal) {
+
+  GtkTreeIter iter;
+  GtkTreePath *path = tree_path(model, node);
+  tree_iter_set(model, &iter, node);
+  if (signal == 0)
+    gtk_tree_model_row_inserted(GTK_TREE_MODEL(model), path, &iter);
+  else
+    gtk_tree_model_row_has_child_toggled(GTK_TREE_MODEL(model), path, &iter);
+  gtk_tree_path_free(path);
+}
+
+static void
+tree_remove(LCITreeModel *model, guint32 node, guint32 pos) {
+
+  guint32 first = model->rows[node].first;
+  guint32 count = model->rows[node].count;
+  GtkTreePath *path = tree_path(model, (first + pos));
+  tree_unload(model, (first + pos));
+  memmove(&model->rows[(first + pos)], &model->rows[(first + pos + 1)],
+          ((count - pos - 1) * sizeof(LCITreeRow)));
+  model->rows[node].count--;
+  for (guint32 idx = pos; idx < (count - 1); idx++)
+    tree_reparent(model, (first + idx));
+  model->stamp++;
+  gtk_tree_model_row_deleted(GTK_TREE_MODEL(model), path);
+  gtk_tree_path_free(path);
+  if ((count == 1) && (node != 0))
+    tree_emit(model, node, 1);
+}
+
+static void
+tree_insert(LCITreeModel *model, guint32 node, LCIIndexEntry *entry) {
+
+  guint32 pos = tree_position(model, node, entry);
+  LCITreeRow *row = &model->rows[node];
+  guint32 count = row->count;
+  if (count == row->capacity) {
+      // run is full, move it to one twice the size
+    guint32 capacity = MAX(8, (row->capacity * 2));
+    guint32 first = tree_run_alloc(model, capacity);
+    row = &model->rows[node];
+    if (count != 0)
+      memcpy(&model->rows[first], &model->rows[row->first],
+             (count * sizeof(LCITreeRow)));
+    if (row->capacity != 0)
+      tree_run_free(model, row->first, row->capacity);
+    row->first = first;
+    row->capacity = capacity;
+    for (guint32 idx = 0; idx < count; idx++)
+      tree_reparent(model, (first + idx));
+  }
+  guint32 first = row->first;
+  memmove(&model->rows[(first + pos + 1)], &model->rows[(first + pos)],
+          ((count - pos) * sizeof(LCITreeRow)));
+  LCITreeRow *child = &model->rows[(first + pos)];
+  child->entry = entry;
+  child->parent = node;
+  child->first = 0;
+  child->count = tree_children(entry);
+  child->capacity = 0;
+  row->count++;
+  for (guint32 idx = (pos + 1); idx <= count; idx++)
+    tree_reparent(model, (first + idx));
+  model->stamp++;
+  tree_emit(model, (first + pos), 0);
+  if (child->count != 0)
+    tree_emit(model, (first + pos), 1);
+  if ((count == 0) && (node != 0))
+    tree_emit(model, node, 1);
+}
+
+static GtkTreeModelFlags
+tree_get_flags(GtkTreeModel *tree_model) {
+
+  (void)tree_model;
+  return 0;
+}
+
+static gint
+tree_get_n_columns(GtkTreeModel *tree_model) {
+
+  (void)tree_model;
+  return TREE_COLUMNS;
+}
+
+static GType
+tree_get_column_type(GtkTreeModel *tree_model, gint column) {
+
+  (void)tree_model;
+  return (column == TREE_IS_DIR) ? G_TYPE_BOOLEAN : G_TYPE_STRING;
+}
+
+static gboolean
+tree_get_iter(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreePath *path) {
+
+  LCITreeModel *model = LCI_TREE_MODEL(tree_model);
+  gint depth;
+  gint *indices = gtk_tree_path_get_indices_with_depth(path, &depth);
+  guint32 node = 0;
+  for (gint level = 0; level < depth; level++) {
+    tree_load(model, node);
+    LCITreeRow *row = &model->rows[node];
+    if ((row->first == 0) || ((guint32)indices[level] >= row->count))
+      return FALSE;
+    node = row->first + indices[level];
+  }
+  return (depth != 0) && tree_iter_set(model, iter, node);
+}
+
+static GtkTreePath *
+tree_get_path(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+
+  LCITreeModel *model = LCI_TREE_MODEL(tree_model);
+  g_return_val_if_fail(iter->stamp == model->stamp, NULL);
+  return tree_path(model, TREE_NODE(iter));
+}
+
+static void
+tree_get_value(GtkTreeModel *tree_model, GtkTreeIter *iter,
+                                         gint column, GValue *value) {
+
+  LCITreeModel *model = LCI_TREE_MODEL(tree_model);
+  g_return_if_fail(iter->stamp == model->stamp);
+  LCIIndexEntry *entry = model->rows[TREE_NODE(iter)].entry;
+  g_value_init(value, tree_get_column_type(tree_model, column));
+  if (column == TREE_NAME)
+    g_value_set_string(value, entry->name);
+  else if (column == TREE_PATH)
+    g_value_set_string(value, entry->path);
+  else
+    g_value_set_boolean(value, (entry->children != NULL));
+}
+
+static gboolean
+tree_iter_step(GtkTreeModel *tree_model, GtkTreeIter *iter, int step) {
+
+  LCITreeModel *model = LCI_TREE_MODEL(tree_model);
+  g_return_val_if_fail(iter->stamp == model->stamp, FALSE);
+  guint32 node = TREE_NODE(iter);
+  LCITreeRow *parent = &model->rows[model->rows[node].parent];
+  guint32 pos = node - parent->first;
+  if ( ((step < 0) && (pos == 0))
+      || ((step > 0) && ((pos + 1) >= parent->count)) ) {
+    iter->stamp = 0;
+    return FALSE;
+  }
+  return tree_iter_set(model, iter, (node + step));
+}
+
+static gboolean
+tree_iter_next(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+
+  return tree_iter_step(tree_model, iter, 1);
+}
+
+static gboolean
+tree_iter_previous(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+
+  return tree_iter_step(tree_model, iter, -1);
+}
+
+static gboolean
+tree_iter_nth_child(GtkTreeModel *tree_model, GtkTreeIter *iter,
+                                              GtkTreeIter *parent, gint n) {
+
+  LCITreeModel *model = LCI_TREE_MODEL(tree_model);
+  guint32 node = (parent != NULL) ? TREE_NODE(parent) : 0;
+  tree_load(model, node);
+  LCITreeRow *row = &model->rows[node];
+  if ((row->first == 0) || (n < 0) || ((guint32)n >= row->count)) {
+    iter->stamp = 0;
+    return FALSE;
+  }
+  return tree_iter_set(model, iter, (row->first + n));
+}
+
+static gboolean
+tree_iter_children(GtkTreeModel *tree_model, GtkTreeIter *iter,
+                                             GtkTreeIter *parent) {
+
+  return tree_iter_nth_child(tree_model, iter, parent, 0);
+}
+
+static gboolean
+tree_iter_has_child(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+
+  LCITreeModel *model = LCI_TREE_MODEL(tree_model);
+  return (model->rows[TREE_NODE(iter)].count != 0);
+}
+
+static gint
+tree_iter_n_children(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+
+  LCITreeModel *model = LCI_TREE_MODEL(tree_model);
+  return model->rows[(iter != NULL) ? TREE_NODE(iter) : 0].count;
+}
+
+static gboolean
+tree_iter_parent(GtkTreeModel *tree_model, GtkTreeIter *iter,
+                                           GtkTreeIter *child) {
+
+  LCITreeModel *model = LCI_TREE_MODEL(tree_model);
+  guint32 parent = model->rows[TREE_NODE(child)].parent;
+  if (parent == 0) {
+    iter->stamp = 0;
+    return FALSE;
+  }
+  return tree_iter_set(model, iter, parent);
+}
+
+static void
+tree_model_iface_init(GtkTreeModelIface *iface) {
+
+  iface->get_flags = tree_get_flags;
+  iface->get_n_columns = tree_get_n_columns;
+  iface->get_column_type = tree_get_column_type;
+  iface->get_iter = tree_get_iter;
+  iface->get_path = tree_get_path;
+  iface->get_value = tree_get_value;
+  iface->iter_next = tree_iter_next;
+  iface->iter_previous = tree_iter_previous;
+  iface->iter_children = tree_iter_children;
+  iface->iter_has_child = tree_iter_has_child;
+  iface->iter_n_children = tree_iter_n_children;
+  iface->iter_nth_child = tree_iter_nth_child;
+  iface->iter_parent = tree_iter_parent;
+}
+
+static void
+lci_tree_model_finalize(GObject *object) {
+
+  LCITreeModel *model = LCI_TREE_MODEL(object);
+  g_free(model->rows);
+  g_array_free(model->holes, TRUE);
+  G_OBJECT_CLASS(lci_tree_model_parent_class)->finalize(object);
+}
+
+static void
+lci_tree_model_class_init(LCITreeModelClass *klass) {
+
+  G_OBJECT_CLASS(klass)->finalize = lci_tree_model_finalize;
+}
+
+static void
+lci_tree_model_init(LCITreeModel *model) {
+
+  model->stamp = g_random_int();
+  model->capacity = 64;
+  model->rows = g_new0(LCITreeRow, model->capacity);
+  model->nrows = 1;
+  model->holes = g_array_new(FALSE, FALSE, sizeof(LCITreeHole));
+}
+
+LCITreeModel *
+lci_tree_model_new(void) {
+
+  return g_object_new(LCI_TYPE_TREE_MODEL, NULL);
+}
+
+/* Model of index with project directory 'top', or empty for NULL.
+ * Not signalled, views are to be given model after, or again.
+ */
+void
+lci_tree_model_reset(LCITreeModel *model, LCIIndexEntry *top) {
+
+  tree_unload(model, 0);
+  model->nrows = 1;
+  g_array_set_size(model->holes, 0);
+  memset(&model->rows[0], 0, sizeof(LCITreeRow));
+  model->rows[0].entry = top;
+  model->stamp++;
+    // top level is always shown
+  tree_load(model, 0);
+}
+
+/* Index's 'dir' had entries added or removed. Changes of its made
+ * run are signalled, an unmade one only when it gains its first
+ * child or loses its last.
+ */
+void
+lci_tree_model_changed(LCITreeModel *model, LCIIndexEntry *dir) {
+
+  guint32 node = tree_find(model, dir);
+  if (node == TREE_NONE)  return;
+
+  if ((node != 0) && (model->rows[node].first == 0)) {
+    guint32 had = model->rows[node].count;
+    model->rows[node].count = dir->children->len;
+    if ((had == 0) != (dir->children->len == 0))
+      tree_emit(model, node, 1);
+    return;
+  }
+
+    // after this, only entries new to run
+  GHashTable *now = g_hash_table_new(NULL, NULL);
+  for (guint idx = 0; idx < dir->children->len; idx++)
+    g_hash_table_add(now, g_ptr_array_index(dir->children, idx));
+  for (guint32 pos = model->rows[node].count; pos > 0; pos--) {
+    LCIIndexEntry *entry = model->rows[(model->rows[node].first + pos - 1)].entry;
+    if (!g_hash_table_remove(now, entry))
+      tree_remove(model, node, (pos - 1));
+  }
+  for (guint idx = 0; idx < dir->children->len; idx++) {
+    LCIIndexEntry *entry = g_ptr_array_index(dir->children, idx);
+    if (g_hash_table_contains(now, entry))
+      tree_insert(model, node, entry);
+  }
+  g_hash_table_destroy(now);
+}
+
+  // a collapsed row, its children's rows are let go
+void
+lci_tree_model_unload(LCITreeModel *model, GtkTreeIter *iter) {
+
+  g_return_if_fail(iter->stamp == model->stamp);
+  tree_unload(model, TREE_NODE(iter));
+  model->stamp++;
+}
+
+LCIIndexEntry *
+lci_tree_model_entry(LCITreeModel *model, GtkTreeIter *iter) {
+
+  g_return_val_if_fail(iter->stamp == model->stamp, NULL);
+  return model->rows[TREE_NODE(iter)].entry;
+}
+
+  // heap held by rows, made or not
+gsize
+lci_tree_model_bytes(LCITreeModel *model) {
+
+  return sizeof(LCITreeModel) + ((gsize)model->capacity * sizeof(LCITreeRow))
+         + ((gsize)model->holes->len * sizeof(LCITreeHole));
+}
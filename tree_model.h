@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2021, Dec 13 Steven Abner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/* Tree model of a project index, for the tree area. A GtkTreeModel
+ * whose rows are made only for directories a view opens: a level is
+ * read from index, sorted, when its first child is asked for, and
+ * dropped again by lci_tree_model_unload() when its row collapses.
+ * Rows live in one array, a level being a run of it, so cost follows
+ * what is on screen rather than project size.
+ */
+#ifndef TREE_MODEL_H
+#define TREE_MODEL_H
+
+#include <gtk/gtk.h>
+#include "project_index.h"
+
+enum {
+  TREE_NAME,
+  TREE_PATH,                      // from project directory
+  TREE_IS_DIR,
+  TREE_COLUMNS
+};
+
+#define LCI_TYPE_TREE_MODEL (lci_tree_model_get_type())
+G_DECLARE_FINAL_TYPE(LCITreeModel, lci_tree_model, LCI, TREE_MODEL, GObject)
+
+LCITreeModel *   lci_tree_model_new(void);
+void             lci_tree_model_reset(LCITreeModel *, LCIIndexEntry *);
+void             lci_tree_model_changed(LCITreeModel *, LCIIndexEntry *);
+void             lci_tree_model_unload(LCITreeModel *, GtkTreeIter *);
+LCIIndexEntry *  lci_tree_model_entry(LCITreeModel *, GtkTreeIter *);
+gsize            lci_tree_model_bytes(LCITreeModel *);
+
+#endif
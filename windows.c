@@ -1,10 +1,21 @@
-// gcc `pkg-config --cflags gtk+-3.0` -o windows windows.c `pkg-config --libs gtk+-3.0`
+// gcc `pkg-config --cflags gtk+-3.0` -o windows windows.c session_store.c project_index.c tree_model.c text_buffer.c font_cache.c recent_catalog.c intern_table.c `pkg-config --libs gtk+-3.0`
 #include <gtk/gtk.h>
+#include <glib-unix.h>
 #include <pwd.h>
 #include <sys/stat.h>
-
-// created event to handle missing gdk/window manager ability
-#define GDK_QUIT GDK_EVENT_LAST
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "session_store.h"
+#include "project_index.h"
+#include "tree_model.h"
+#include "text_buffer.h"
+#include "font_cache.h"
+#include "recent_catalog.h"
+#include "intern_table.h"
 
 /*
  * Copyright (c) 2021, Dec 13 Steven Abner
@@ -46,11 +57,17 @@
   project => path/name_project.lproj
  */
 
-/* Amount limiting User's Sessions */
-#define LCISESSION_LIMIT 16
 #define NEW_WINDOW_WIDTH 650
 #define NEW_WINDOW_HEIGHT 400
 
+  // a session's share of process, see usage_json()
+typedef struct _LciUsage {
+  guint64          dispatches;      // its handlers run on main loop
+  gint64           main_us;         // main loop time spent for it
+  guint64          read;            // session file bytes restored
+  guint64          written;         // session file and journal bytes saved, before deflate
+} LCIUsage;
+
 typedef struct _LciSession {
   GtkWidget       *main_window;
     // interface additions to main_window
@@ -60,12 +77,34 @@ typedef struct _LciSession {
 //  LCITreeArea     *tree_area;       // left of second split
 //  LCIEditorArea   *editor_area;     // right of second split
     // window management not part of GtkWindow
-  char            *project_name;    // if not NULL, is a project instead of editor
-  char            *session_file;  // Location of work/save for session
+    // strings interned, see intern_table.h
+  const char      *project_name;    // if not NULL, is a project instead of editor
+  const char      *session_file;  // Location of work/save for session
+  const char      *title;         // main_window's
   int sslot;                      // LCISession's session number
-  int order;                      // position compared to others on screen
+  struct _LciSession *above;      // stacking order, NULL is foreground
+  struct _LciSession *below;      // NULL is bottom-most
   int maximized;                  // main_window status
+  int closing;                    // 'delete' received, awaiting save
+  int realized;                   // interface built
+  int hibernated;                 // interface torn down, see session_hibernate()
+  gint64 used;                    // last registered or focused, monotonic µs
   int pt_x, pt_y, sz_x, sz_y;     // main_window position/size
+  int pending;                    // events noted, not yet applied
+  int dirty;                      // changed since last save
+  int unlogged;                   // changed, not yet in journal
+  int ev_x, ev_y, ev_maximized;   // latest noted event values
+  struct _LciSession *next_pending;
+  GtkWidget       *paned;           // tree area left, text area right
+  GtkWidget       *tree_view;       // tree area, kept with pooled window
+  GtkWidget       *editor_box;      // text area, kept with pooled window
+  LCITreeModel    *tree_model;
+  LCIProjectIndex *project_index;   // project's files, NULL for editor
+  struct _LciDocument *document;    // editor area's, shared, NULL for none
+  int              text_stored;     // document let go, see session_hibernate_done()
+  uint64_t         cursor;          // editor area's view of it
+  double           scroll;
+  LCIUsage         usage;
     // more interface additions
 //  int pd_x;
 //  GtkClipboard  *clipboard;       // selection/DnD copying
@@ -76,6 +115,10 @@ LCISession *  lci_session_create(char *);
 LCISession *  lci_session_open(char *);
 gboolean      lci_session_close(GtkWidget *, GdkEvent *, LCISession *);
 void          lci_session_quit(LCISession *);
+int           lci_recent_find(const char *, LCIRecentEntry **, int);
+int           lci_textport_open(LCISession *, const char *);
+int           lci_textport_flatten(LCISnapshot *, LCISession *);
+void          lci_textport_reset(LCISession *);
 
   // start of private
 /* On Elementary OS, OS application height, was 30 */
@@ -84,12 +127,252 @@ void          lci_session_quit(LCISession *);
 #define GTK_WINDOW_OFFSET_X  79
 #define GTK_WINDOW_OFFSET_Y  35
 
-static LCISession *session_stack[LCISESSION_LIMIT];
-static int nsessions;
 static char name_of_session[32] = { "Sessions" };
 static int total_created_sessions = 0;
 #define NOS_APPEND  8
-static char master_file[1024] = { '.', '/', 0 };
+static char *master_file;          // set by session_start()
+
+/* Tracing. With LCI_TRACE=<file> in environment, or --trace=<file>
+ * on command line, spans of start up and of each session's life are
+ * recorded and written on exit as Chrome trace JSON, for
+ * chrome://tracing or ui.perfetto.dev. Disabled, trace_now() and
+ * trace_span() are a test of 'trace_file'.
+ */
+typedef struct _LciTraceEvent {
+  const char  *name;              // static string
+  gint64       start;             // µs from trace_origin
+  gint64       duration;          // < 0 for instant event
+  int          tid;               // 1 main thread, then workers
+  char        *session;           // session attributed, or NULL
+} LCITraceEvent;
+
+static const char *trace_file;
+static gint64 trace_origin;
+static LCITraceEvent *trace_events;
+static int trace_count, trace_capacity;
+static GMutex trace_lock;
+static volatile gint trace_threads = 1;
+static __thread int trace_tid;
+
+static inline gint64
+trace_now(void) {
+  return (trace_file == NULL) ? 0 : g_get_monotonic_time();
+}
+
+static void
+trace_record(const char *name, gint64 start, gint64 duration,
+                                             const char *session) {
+
+    // main thread is set by trace_init()
+  if (trace_tid == 0)
+    trace_tid = g_atomic_int_add(&trace_threads, 1) + 1;
+  g_mutex_lock(&trace_lock);
+  if (trace_count == trace_capacity) {
+    trace_capacity = (trace_capacity == 0) ? 256 : (trace_capacity * 2);
+    trace_events = realloc(trace_events, trace_capacity * sizeof(LCITraceEvent));
+  }
+  LCITraceEvent *event = &trace_events[trace_count++];
+  event->name = name;
+  event->start = start - trace_origin;
+  event->duration = duration;
+  event->tid = trace_tid;
+  event->session = (session != NULL) ? strdup(session) : NULL;
+  g_mutex_unlock(&trace_lock);
+}
+
+  // span from 'start', a trace_now(), to now. 'session' a session_file
+static void
+trace_span(const char *name, gint64 start, const char *session) {
+
+  if (trace_file == NULL)  return;
+  trace_record(name, start, (g_get_monotonic_time() - start), session);
+}
+
+static void
+trace_instant(const char *name, const char *session) {
+
+  if (trace_file == NULL)  return;
+  trace_record(name, g_get_monotonic_time(), -1, session);
+}
+
+static void
+trace_json_string(FILE *th, const char *str) {
+
+  fputc('"', th);
+  for (; *str != 0; str++) {
+    if ((*str == '"') || (*str == '\\'))
+      fprintf(th, "\\%c", *str);
+    else if ((unsigned char)*str < 0x20)
+      fprintf(th, "\\u%04x", *str);
+    else
+      fputc(*str, th);
+  }
+  fputc('"', th);
+}
+
+static void
+trace_init(int *argc, char **argv) {
+
+  trace_file = g_getenv("LCI_TRACE");
+  for (int idx = 1; idx < *argc; idx++) {
+    if (strncmp(argv[idx], "--trace=", 8) == 0) {
+      trace_file = &argv[idx][8];
+        // not for gtk_init()
+      memmove(&argv[idx], &argv[(idx + 1)], (*argc - idx) * sizeof(char *));
+      (*argc)--;
+      break;
+    }
+  }
+  if ((trace_file != NULL) && (*trace_file == 0))
+    trace_file = NULL;
+  if (trace_file != NULL) {
+    trace_tid = 1;
+    trace_origin = g_get_monotonic_time();
+  }
+}
+
+static void
+trace_export(void) {
+
+  if (trace_file == NULL)  return;
+  FILE *th = fopen(trace_file, "w");
+  if (th == NULL) {
+    puts("ERROR: unable to write trace");
+    return;
+  }
+  fprintf(th, "{\"traceEvents\":[\n");
+  for (int idx = 0; idx < trace_count; idx++) {
+    LCITraceEvent *event = &trace_events[idx];
+    fprintf(th, "%s{\"name\":", (idx == 0) ? "" : ",\n");
+    trace_json_string(th, event->name);
+    fprintf(th, ",\"cat\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%" G_GINT64_FORMAT,
+                (event->session != NULL) ? "session" : "app",
+                (int)getpid(), event->tid, event->start);
+    if (event->duration < 0)
+      fprintf(th, ",\"ph\":\"i\",\"s\":\"t\"");
+    else
+      fprintf(th, ",\"ph\":\"X\",\"dur\":%" G_GINT64_FORMAT, event->duration);
+    if (event->session != NULL) {
+      fprintf(th, ",\"args\":{\"session\":");
+      trace_json_string(th, event->session);
+      fputc('}', th);
+    }
+    fputc('}', th);
+    free(event->session);
+  }
+  fprintf(th, "\n],\"displayTimeUnit\":\"ms\"}\n");
+  fclose(th);
+  free(trace_events);
+  trace_events = NULL;
+  trace_count = trace_capacity = 0;
+}
+
+/* Session records. Carved SESSION_SLAB at a time from one allocation,
+ * a closed session's record goes on 'session_spare' for the next open.
+ * Records never go back to malloc, so thousands of opens and closes
+ * leave the heap as the first few did.
+ */
+#define SESSION_SLAB  64
+
+static LCISession *session_spare;   // through 'below'
+
+  // zeroed
+static LCISession *
+session_alloc(void) {
+
+  if (session_spare == NULL) {
+    LCISession *slab = malloc(SESSION_SLAB * sizeof(LCISession));
+    for (int idx = 0; idx < SESSION_SLAB; idx++) {
+      slab[idx].below = session_spare;
+      session_spare = &slab[idx];
+    }
+  }
+  LCISession *session = session_spare;
+  session_spare = session->below;
+  memset(session, 0, sizeof(LCISession));
+  return session;
+}
+
+static void
+session_dispose(LCISession *session) {
+
+  session->below = session_spare;
+  session_spare = session;
+}
+
+/* Session registry. 'session_stack' grows as needed, slots vacated
+ * by a close are reused through 'session_free'. Stacking order is a
+ * most recently used list threaded through the sessions themselves,
+ * 'session_top' being foreground. Neither a focus change nor a close
+ * walks other sessions, order numbers are only counted out on save.
+ */
+static LCISession **session_stack;
+static int *session_free;         // vacated slots, reused first
+static int session_capacity;
+static int nslots, nfree;         // slots handed out, slots vacated
+static int nsessions;
+static LCISession *session_top, *session_bottom;
+
+  // link at foreground
+static void
+session_stack_push(LCISession *session) {
+
+  session->above = NULL;
+  session->below = session_top;
+  if (session_top != NULL)  session_top->above = session;
+  else                      session_bottom = session;
+  session_top = session;
+}
+
+static void
+session_stack_unlink(LCISession *session) {
+
+  if (session->above != NULL)  session->above->below = session->below;
+  else                         session_top = session->below;
+  if (session->below != NULL)  session->below->above = session->above;
+  else                         session_bottom = session->above;
+}
+
+  // assigns a slot, session becomes foreground
+static void
+session_register(LCISession *session) {
+
+  int slot;
+  if (nfree > 0) {
+    slot = session_free[(--nfree)];
+  } else {
+    if (nslots == session_capacity) {
+      session_capacity = (session_capacity == 0) ? 16 : (session_capacity * 2);
+      session_stack = realloc(session_stack,
+                              session_capacity * sizeof(LCISession *));
+      session_free = realloc(session_free, session_capacity * sizeof(int));
+    }
+    slot = nslots++;
+  }
+  session_stack[slot] = session;
+  session->sslot = slot;
+  session_stack_push(session);
+  session->used = g_get_monotonic_time();
+  nsessions++;
+}
+
+static void
+session_unregister(LCISession *session) {
+
+  session_stack[session->sslot] = NULL;
+  session_free[nfree++] = session->sslot;
+  session_stack_unlink(session);
+  nsessions--;
+}
+
+  // to foreground
+static void
+session_raise(LCISession *session) {
+
+  if (session == session_top)  return;
+  session_stack_unlink(session);
+  session_stack_push(session);
+}
 
 
 /* inerface type examples */
@@ -101,72 +384,728 @@ session_interface_pane_status(GtkPaned *widget,
   return FALSE;
 }
 
-  // set desired font in an interface
+/* Text area's font, from font cache shared by all sessions. First
+ * asking loads cache as last saved, and has font or settings changes
+ * invalidate it. Cache is saved with master, see session_commit().
+ */
+#define TEXTPORT_FONT "Monospace 10"
+
 static void
-do_try_font(void) {
+font_settings_changed(GObject *settings, GParamSpec *pspec, gpointer data) {
+
+  (void)settings, (void)pspec, (void)data;
+  font_cache_invalidate();
+}
+
+  // set desired font in an interface
+static const LCIFont *
+do_try_font(GtkWidget *widget) {
+
+  static int watching = 0;
+  if (!watching) {
+    static const char *signals[] = {
+      "notify::gtk-font-name", "notify::gtk-xft-dpi",
+      "notify::gtk-xft-antialias", "notify::gtk-xft-hinting",
+      "notify::gtk-xft-hintstyle", "notify::gtk-xft-rgba"
+    };
+    GtkSettings *settings = gtk_settings_get_default();
+    for (size_t idx = 0; idx < G_N_ELEMENTS(signals); idx++)
+      g_signal_connect(settings, signals[idx],
+                                 G_CALLBACK(font_settings_changed), NULL);
+    char *cache_file = g_strconcat(master_file, FONT_CACHE_SUFFIX, NULL);
+    font_cache_load(cache_file);
+    g_free(cache_file);
+    watching = 1;
+  }
+  return font_cache_get(gtk_widget_get_pango_context(widget), TEXTPORT_FONT);
 }
   // where a textwindow should go, ability to swap in different ones
 static GtkWidget *
 session_textarea_create(LCISession *session) {
   GtkWidget *editor_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
-  do_try_font();
+  do_try_font(editor_box);
   return editor_box;
 }
+
+/* Documents. One LCIDocument per file however many sessions show
+ * it, found by canonical path and inode, and let go with its last
+ * session. A session has its own cursor and scroll over it. Unnamed
+ * documents are never shared, nor are edits restored for a file
+ * already open with others. Main thread only, but document_key(),
+ * which decoders use.
+ */
+typedef struct _LciDocument {
+  LCITextBuffer  *text;
+  char           *key;            // NULL when unnamed, or kept apart
+  int             refs;
+  guint           commit;         // last commit it was written in
+  const char     *owner;          // session file it was written to, interned
+} LCIDocument;
+
+static GHashTable *documents;     // key to LCIDocument
+static guint textport_commit;
+
+  // any thread, it goes to file system
+static char *
+document_key(const char *path) {
+
+  struct stat st;
+  if (path == NULL)  return NULL;
+  char *canonical = realpath(path, NULL);
+  if ((canonical == NULL) || (stat(canonical, &st) != 0)) {
+    free(canonical);
+    return NULL;
+  }
+  char *key = g_strdup_printf("%llu:%s", (unsigned long long)st.st_ino,
+                                         canonical);
+  free(canonical);
+  return key;
+}
+
+/* Takes 'text' and 'key', its document_key(), 'owner' the session
+ * file its edits were read from, or NULL. Frees them for an already
+ * open document, unless 'text' has edits of its own, not read from
+ * where that document's were, then it is a document kept apart.
+ */
+static LCIDocument *
+document_adopt(LCITextBuffer *text, char *key, const char *owner) {
+
+  if (documents == NULL)
+    documents = g_hash_table_new(g_str_hash, g_str_equal);
+  LCIDocument *document;
+  if ( (key != NULL)
+      && ((document = g_hash_table_lookup(documents, key)) != NULL) ) {
+    g_free(key);
+    if ( text_buffer_modified(text)
+        && ( (owner == NULL) || (document->owner == NULL)
+            || (strcmp(owner, document->owner) != 0) ) ) {
+      printf("ERROR: %s open with other edits, these kept apart\n",
+                                                text_buffer_path(text));
+      key = NULL;
+    } else {
+      text_buffer_free(text);
+      document->refs++;
+      return document;
+    }
+  }
+  document = calloc(1, sizeof(LCIDocument));
+  document->text = text;
+  document->key = key;
+  document->refs = 1;
+  if (owner != NULL)
+    document->owner = intern_string(owner);
+  if (key != NULL)
+    g_hash_table_insert(documents, key, document);
+  return document;
+}
+
+static LCIDocument *
+document_find(const char *key) {
+
+  LCIDocument *document = NULL;
+  if ((key != NULL) && (documents != NULL))
+    document = g_hash_table_lookup(documents, key);
+  if (document != NULL)
+    document->refs++;
+  return document;
+}
+
+static LCIDocument *
+document_open(const char *path) {
+
+  char *key = document_key(path);
+  LCIDocument *document = document_find(key);
+  if (document != NULL) {
+    g_free(key);
+    return document;
+  }
+  LCITextBuffer *text = text_buffer_open(path);
+  if (text == NULL) {
+    g_free(key);
+    return NULL;
+  }
+  return document_adopt(text, key, NULL);
+}
+
+static void
+document_release(LCIDocument *document) {
+
+  if ((document == NULL) || (--document->refs > 0))  return;
+  if (document->key != NULL)
+    g_hash_table_remove(documents, document->key);
+  text_buffer_free(document->text);
+  g_free(document->key);
+  intern_release(document->owner);
+  free(document);
+}
+
+/* Text port, the editor area's view of a document, see text_buffer.h.
+ * Its textport section is this view's cursor and scroll, then either
+ * the document's edits, or for a document already written in this
+ * commit by another session, that session's file and the path. Each
+ * document is then written once per commit.
+ */
+typedef struct _LciTextportRecord {
+  uint64_t  cursor;
+  double    scroll;
+  uint32_t  shared;               // owner's file and path follow
+  uint32_t  reserved;
+} LCITextportRecord;              // then LCITextRecord when not shared
+
+typedef struct _LciTextportRestore {
+  LCITextBuffer  *text;           // decoded edits
+  LCIDocument    *document;       // 'text' once registered
+  char           *owner;          // shared, where edits were written
+  char           *path;
+  char           *key;            // document_key() of its file, decoder's
+  uint64_t        cursor;
+  double          scroll;
+} LCITextportRestore;
+
+  // new commit, each document is written again, once
+static void
+textport_commit_start(void) {
+  textport_commit++;
+}
+
+/* NULL 'path' is a new, unnamed document. Any previous one is let
+ * go, its edits with it if no other session shows it.
+ */
+int
+lci_textport_open(LCISession *session, const char *path) {
+
+  LCIDocument *document = document_open(path);
+  if (document == NULL) {
+    printf("ERROR: unable to open %s\n", path);
+    return GTK_RESPONSE_CANCEL;
+  }
+  lci_textport_reset(session);
+  session->document = document;
+    // any hibernated one's is no longer its
+  session->text_stored = 0;
+  return GTK_RESPONSE_ACCEPT;
+}
+
+  // edits go in session file, original stays as it is
+int
+lci_textport_flatten(LCISnapshot *snap, LCISession *session) {
+
+  LCIDocument *document = session->document;
+  if (document == NULL) {
+      // a hibernated session's is still in its file
+    snap->keep_text = session->text_stored;
+    return GTK_RESPONSE_ACCEPT;
+  }
+
+  LCITextportRecord header = { session->cursor, session->scroll, 0, 0 };
+  const char *path = text_buffer_path(document->text);
+  char *record;
+  uint32_t length;
+  if ((document->commit == textport_commit) && (document->key != NULL)) {
+    header.shared = 1;
+    size_t owner_len = strlen(document->owner) + 1;
+    length = sizeof(LCITextportRecord) + owner_len + strlen(path) + 1;
+    record = malloc(length);
+    memcpy((record + sizeof(LCITextportRecord)), document->owner, owner_len);
+    strcpy((record + sizeof(LCITextportRecord) + owner_len), path);
+  } else {
+      // flattened behind its header, no second copy of edits
+    record = text_buffer_flatten(document->text, sizeof(LCITextportRecord),
+                                                 &length);
+    if (record == NULL) {
+      puts("ERROR: document's edits too large to save in session");
+      return GTK_RESPONSE_CANCEL;
+    }
+    document->commit = textport_commit;
+    if (document->owner != snap->session_file) {
+      intern_release(document->owner);
+      document->owner = intern_ref(snap->session_file);
+    }
+  }
+  memcpy(record, &header, sizeof(LCITextportRecord));
+  snap->text = record;
+  snap->text_len = length;
+  return GTK_RESPONSE_ACCEPT;
+}
+
+void
+lci_textport_reset(LCISession *session) {
+
+  document_release(session->document);
+  session->document = NULL;
+  session->cursor = 0;
+  session->scroll = 0;
+}
+
+static void
+textport_restore_free(LCITextportRestore *restore) {
+
+  if (restore == NULL)  return;
+  text_buffer_free(restore->text);
+  document_release(restore->document);
+  free(restore->owner);
+  free(restore->path);
+  g_free(restore->key);
+  free(restore);
+}
+
+  // text buffer's LCITextRead over a payload stream
+static int
+textport_read(void *stream, void *out, size_t length) {
+
+  gsize got = 0;
+  return (!g_input_stream_read_all(stream, out, length, &got, NULL, NULL))
+         || (got != length);
+}
+
+/* Decoder's side, any thread, an LCIStoreDecoder. Stored edits
+ * become a text buffer as they are inflated, or are dropped if their
+ * original changed while closed. A shared one is found once on main
+ * thread. Return NULL for a record not valid.
+ */
+static void *
+textport_decode(GInputStream *stream, uint32_t length) {
+
+  LCITextportRecord header;
+  if ((length < sizeof(header)) || textport_read(stream, &header, sizeof(header)))
+    return NULL;
+  uint32_t body_len = length - sizeof(header);
+  LCITextportRestore *restore = calloc(1, sizeof(LCITextportRestore));
+  restore->cursor = header.cursor;
+  restore->scroll = header.scroll;
+  if (header.shared) {
+      // owner's file and path, short
+    char *body = malloc(body_len);
+    const char *path = (body_len == 0) || textport_read(stream, body, body_len)
+                       ? NULL : memchr(body, 0, body_len);
+    if ( (path == NULL) || (body[(body_len - 1)] != 0)
+        || (++path == (body + body_len)) || store_payload_end(stream) ) {
+      free(body);
+      free(restore);
+      return NULL;
+    }
+    restore->owner = strdup(body);
+    restore->path = strdup(path);
+    restore->key = document_key(restore->path);
+    free(body);
+    return restore;
+  }
+  int stale = 0;
+  restore->text = text_buffer_unflatten(textport_read, stream, body_len, &stale);
+    // whole stream taken, a deflated one's check with it
+  if ((restore->text != NULL) && (!stale) && store_payload_end(stream)) {
+    text_buffer_free(restore->text);
+    restore->text = NULL;
+  }
+  if (restore->text == NULL) {
+    free(restore);
+    return NULL;
+  }
+  if (stale)
+    printf("ERROR: %s changed, session's edits dropped\n",
+                                       text_buffer_path(restore->text));
+  restore->key = document_key(text_buffer_path(restore->text));
+  return restore;
+}
+
+  // session file read, its textport decoded as read
+static void
+textport_unflatten(LCIRestore *entry) {
+
+  store_decode(entry, textport_decode);
+  if ((entry->stored_text_len != 0) && (entry->text == NULL))
+    printf("ERROR: %s document not restored\n", entry->path);
+}
+
+  // main thread, before any shared one needs it, read from 'session_file'
+static void
+textport_register(LCITextportRestore *restore, const char *session_file) {
+
+  if ((restore == NULL) || (restore->text == NULL))  return;
+  restore->document = document_adopt(restore->text, restore->key,
+                                                    session_file);
+  restore->text = NULL;
+  restore->key = NULL;
+}
+
+  // shared, from 'owner', its owner's decoded textport, taken
+static LCIDocument *
+textport_owner_found(LCITextportRestore *restore, LCITextportRestore *owner) {
+
+  LCIDocument *document;
+  if ( (owner != NULL) && (owner->text != NULL) && (restore->key != NULL)
+      && (owner->key != NULL) && (strcmp(restore->key, owner->key) == 0) )
+    textport_register(owner, restore->owner);
+  if ((owner != NULL) && (owner->document != NULL)) {
+    document = owner->document;
+    owner->document = NULL;
+  } else {
+    printf("ERROR: %s edits not found in %s\n", restore->path, restore->owner);
+    document = document_open(restore->path);
+  }
+  textport_restore_free(owner);
+  return document;
+}
+
+  // shared, edits are in owner's session file when not open here
+static LCIDocument *
+textport_owner(LCITextportRestore *restore) {
+
+  LCIDocument *document = document_find(restore->key);
+  if (document != NULL)  return document;
+
+  LCIRestore entry = { restore->owner };
+  textport_unflatten(&entry);
+  free(entry.stored_title);
+  return textport_owner_found(restore, entry.text);
+}
+
+  // takes 'restore', a session's decoded textport
+static void
+textport_attach(LCISession *session, LCITextportRestore *restore) {
+
+  if (restore == NULL)  return;
+  textport_register(restore, session->session_file);
+  if (restore->document == NULL)
+    restore->document = textport_owner(restore);
+  session->document = restore->document;
+  session->cursor = restore->cursor;
+  session->scroll = restore->scroll;
+  restore->document = NULL;
+  textport_restore_free(restore);
+}
+
+static void textport_reload(LCISession *);
+
+/* Tree area. Shows a project's index, see tree_model.h. Rows are
+ * made as the view opens directories, and let go when they close.
+ */
+static void
+tree_reset(LCISession *session, LCIIndexEntry *top) {
+
+    // detached, a view would otherwise be told row by row
+  GtkTreeView *view = GTK_TREE_VIEW(session->tree_view);
+  gtk_tree_view_set_model(view, NULL);
+  lci_tree_model_reset(session->tree_model, top);
+  gtk_tree_view_set_model(view, GTK_TREE_MODEL(session->tree_model));
+}
+
+static void
+tree_index_changed(LCIProjectIndex *index, LCIIndexEntry *dir, gpointer data) {
+
+  LCISession *session = data;
+  gint64 start = g_get_monotonic_time();
+  if (dir == NULL)
+    tree_reset(session, project_index_root(index));
+  else
+    lci_tree_model_changed(session->tree_model, dir);
+  session->usage.dispatches++;
+  session->usage.main_us += g_get_monotonic_time() - start;
+}
+
+static void
+tree_collapsed(GtkTreeView *view, GtkTreeIter *iter, GtkTreePath *path,
+                                                     LCISession *session) {
+
+  (void)view, (void)path;
+  lci_tree_model_unload(session->tree_model, iter);
+}
+
+/* A project's session file is in its project directory, editors'
+ * are in a directory of master's, named as lci_session_create()
+ * names them. Project's name is its directory's, interned, NULL for
+ * an editor session.
+ */
+static const char *
+session_project_name(const char *session_file) {
+
+  int dir_len = (strrchr(master_file, '/') + 1) - master_file;
+  if (strncmp(session_file, master_file, dir_len) == 0) {
+    const char *slash = strchr((session_file + dir_len), '/');
+    if ((slash != NULL) && (strcmp(slash, "/session.lproj") == 0))
+      return NULL;
+  }
+  char *directory = g_path_get_dirname(session_file);
+  char *name = g_path_get_basename(directory);
+  const char *project_name = intern_string(name);
+  g_free(name);
+  g_free(directory);
+  return project_name;
+}
+
+/* A project's index is opened once realized, a background session
+ * waits for its realization.
+ */
+static void
+session_index_open(LCISession *session) {
+
+  if ( (session->project_index != NULL) || (session->project_name == NULL)
+      || (session->tree_view == NULL) )
+    return;
+  char *directory = g_path_get_dirname(session->session_file);
+  session->project_index = project_index_open(directory,
+                                              tree_index_changed, session);
+  g_free(directory);
+}
+
+static void
+session_index_close(LCISession *session) {
+
+  if (session->project_index == NULL)  return;
+  project_index_close(session->project_index);
+  session->project_index = NULL;
+  tree_reset(session, NULL);
+}
+
   // where display a treeview
 static GtkWidget *
 session_treearea_create(LCISession *session) {
   GtkWidget *tree_window = gtk_scrolled_window_new(NULL, NULL);
+  session->tree_model = lci_tree_model_new();
+  session->tree_view = gtk_tree_view_new_with_model(
+                                  GTK_TREE_MODEL(session->tree_model));
+  GtkTreeView *view = GTK_TREE_VIEW(session->tree_view);
+  gtk_tree_view_set_headers_visible(view, FALSE);
+    // fixed height, rows are not measured until on screen
+  GtkTreeViewColumn *column = gtk_tree_view_column_new_with_attributes(NULL,
+                           gtk_cell_renderer_text_new(), "text", TREE_NAME, NULL);
+  gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_expand(column, TRUE);
+  gtk_tree_view_append_column(view, column);
+  gtk_tree_view_set_fixed_height_mode(view, TRUE);
+  g_signal_connect(G_OBJECT(session->tree_view), "row-collapsed",
+                                    G_CALLBACK(tree_collapsed), session);
+  gtk_container_add(GTK_CONTAINER(tree_window), session->tree_view);
   return tree_window;
 }
   // create what main_window will display
 static void
 session_interface_create(LCISession *session) {
   GtkWidget *tree_window = session_treearea_create(session);
-  GtkWidget *editor_box = session_textarea_create(session);
+  session->editor_box = session_textarea_create(session);
+  session->paned = gtk_paned_new(GTK_ORIENTATION_HORIZONTAL);
+  GtkPaned *paned = GTK_PANED(session->paned);
+  gtk_paned_pack1(paned, tree_window, FALSE, FALSE);
+  gtk_paned_pack2(paned, session->editor_box, TRUE, FALSE);
+  gtk_paned_set_position(paned, (NEW_WINDOW_WIDTH / 5));
+  gtk_container_add(GTK_CONTAINER(session->main_window), session->paned);
+}
+
+/* Deferred realization. A restored session further back than
+ * foreground starts as just its window, with title and geometry.
+ * Its interface gets built when it is raised, or from an idle
+ * source at low priority, front to back, a REALIZE_BUDGET_US slice
+ * of main loop at a time.
+ */
+#define REALIZE_BUDGET_US 4000
+static guint session_realize_source;
+
+static void
+session_realize(LCISession *session) {
+
+  if (session->realized)  return;
+  gint64 start = trace_now();
+  gint64 began = g_get_monotonic_time();
+  session->realized = 1;
+  session->hibernated = 0;
+  session_interface_create(session);
+  if (session->text_stored)
+    textport_reload(session);
+  session_index_open(session);
+    // window may already be on screen
+  if (gtk_widget_get_visible(session->main_window))
+    gtk_widget_show_all(session->main_window);
+  session->usage.main_us += g_get_monotonic_time() - began;
+  trace_span("session_realize", start, session->session_file);
+}
+
+static gboolean
+session_realize_idle(gpointer data) {
+
+  (void)data;
+  gint64 start = g_get_monotonic_time();
+  for (LCISession *session = session_top; session != NULL;
+                                          session = session->below) {
+      // a hibernated one waits to be raised
+    if (session->realized || session->hibernated)  continue;
+    if ((g_get_monotonic_time() - start) > REALIZE_BUDGET_US)
+      return G_SOURCE_CONTINUE;
+    session_realize(session);
+  }
+  session_realize_source = 0;
+  return G_SOURCE_REMOVE;
+}
+
+static void
+session_realize_later(void) {
+
+  if (session_realize_source == 0)
+    session_realize_source = g_idle_add_full(G_PRIORITY_LOW,
+                                   session_realize_idle, NULL, NULL);
 }
 
 
-/* Captures <control><shift><n> to create a new session window */
+static void usage_view(void);
+
+/* Captures <control><shift><n> to create a new session window,
+ * <control><shift><i> to show or hide resource usage.
+ */
 static gboolean
 session_keypress(GtkWidget *widget, GdkEventKey *event, LCISession *session) {
 
-  if (((nsessions + 1) <= LCISESSION_LIMIT) && (event->keyval == GDK_KEY_N)) {
+  if (event->keyval == GDK_KEY_N) {
     if ((event->state & GDK_SHIFT_MASK) && (event->state & GDK_CONTROL_MASK)) {
       lci_session_create(NULL);
       return TRUE;
     }
   }
+  if (event->keyval == GDK_KEY_I) {
+    if ((event->state & GDK_SHIFT_MASK) && (event->state & GDK_CONTROL_MASK)) {
+      usage_view();
+      return TRUE;
+    }
+  }
   return FALSE;
 }
 
-/* Captures gdk GDK_FOCUS_CHANGE event for keeping track of session window order.
- * Also use to check focus-in active port has been externally changed. */
-/* Any click on window header will send a double event of TRUE.
- * Actually sends focus out, focus in, focus out, focus in */
-/* guess need to attach "click" for headerbar, but noway to get headerbar widget */
-static gboolean
-session_reorder(GtkWidget *widget, GdkEvent *event, LCISession *session) {
+/* Event coalescing. 'configure-event' arrives at frame rate during
+ * a drag or resize, a header click sends focus twice. Handlers only
+ * note what arrived and queue their session once, session_flush()
+ * then applies each session's latest state once per frame, after
+ * drawing. What changed is kept in 'dirty' until saved.
+ */
+enum {
+  SESSION_GEOMETRY  = 1 << 0,     // position/size
+  SESSION_STATE     = 1 << 1,     // maximized
+  SESSION_ORDER     = 1 << 2,     // raised in stacking order
+};
+static LCISession *session_pending;   // queue, through 'next_pending'
+static LCISession *session_focused;   // latest focus-in of queue
+static guint session_flush_source;
 
-    // all above this session(moved foreground), move bakwards
-  if (event->type == GDK_FOCUS_CHANGE) {
-      // want only 1 focus_change.in when header clicked
-      // note change by click on any part other than header sends once
-    int order = session->order;
-    if (order != 0) {
-      for (int idx = 0;
-          ((idx < LCISESSION_LIMIT) && (session_stack[idx] != NULL)); idx++)
-        if (session_stack[idx]->order < order)  session_stack[idx]->order++;
-      session->order = 0;
-    } else {
-        // needed for correct behavior of session not switched
-        // but instead was window (titlebar, resized) clicked
-//      if (session->editor_area->editor_view[0] != NULL)
-//        session->editor_area->editor_view[0]->focus_state = GTK_STATE_FLAG_NORMAL;
-    }
-//    lci_textport_check_status(session);
+static void journal_schedule(void);
+
+  // applied change, for save and journal
+static void
+session_changed(LCISession *session, int what) {
+
+  session->dirty |= what;
+  session->unlogged |= what;
+  journal_schedule();
+}
+
+  // to foreground, else check focus-in active port
+static void
+session_focus(LCISession *session) {
+
+  if (session != session_top) {
+    session_raise(session);
+    session_changed(session, SESSION_ORDER);
+  } else {
+      // needed for correct behavior of session not switched
+      // but instead was window (titlebar, resized) clicked
+//    if (session->editor_area->editor_view[0] != NULL)
+//      session->editor_area->editor_view[0]->focus_state = GTK_STATE_FLAG_NORMAL;
   }
-    // need false else text caret won't show
-  return FALSE;
+//  lci_textport_check_status(session);
+}
+
+static gboolean
+session_flush(gpointer data) {
+
+  (void)data;
+  session_flush_source = 0;
+
+  LCISession *session = session_pending, *next;
+  session_pending = NULL;
+  for (; session != NULL; session = next) {
+    next = session->next_pending;
+    int pending = session->pending;
+    session->pending = 0;
+    if ((pending & SESSION_STATE)
+        && (session->maximized != session->ev_maximized)) {
+      session->maximized = session->ev_maximized;
+      session_changed(session, SESSION_STATE);
+    }
+    if ((pending & SESSION_GEOMETRY) && (session->maximized == 0)) {
+      int sz_x, sz_y;
+        // because of wayland, gdk configure size wrong
+        // works for both
+      gtk_window_get_size(GTK_WINDOW(session->main_window), &sz_x, &sz_y);
+      if ( (session->pt_x != session->ev_x) || (session->pt_y != session->ev_y)
+          || (session->sz_x != sz_x) || (session->sz_y != sz_y) ) {
+        session->pt_x = session->ev_x, session->pt_y = session->ev_y;
+        session->sz_x = sz_x, session->sz_y = sz_y;
+        session_changed(session, SESSION_GEOMETRY);
+      }
+    }
+      // latest focused goes last, ending foreground
+    if ((pending & SESSION_ORDER) && (session != session_focused))
+      session_focus(session);
+  }
+  if (session_focused != NULL) {
+    session_focus(session_focused);
+    session_focused = NULL;
+  }
+  return G_SOURCE_REMOVE;
+}
+
+static void
+session_queue(LCISession *session, int what) {
+
+  if (session->pending == 0) {
+    session->next_pending = session_pending;
+    session_pending = session;
+  }
+  session->pending |= what;
+  if (session_flush_source == 0)
+    session_flush_source = g_idle_add_full((GDK_PRIORITY_REDRAW + 10),
+                                           session_flush, NULL, NULL);
+}
+
+  // state must be current before a save
+static void
+session_flush_now(void) {
+
+  if (session_flush_source != 0) {
+    g_source_remove(session_flush_source);
+    session_flush(NULL);
+  }
+}
+
+  // session leaving, may not be left in queue
+static void
+session_dequeue(LCISession *session) {
+
+  if (session_focused == session)  session_focused = NULL;
+  if (session->pending == 0)  return;
+  LCISession **link = &session_pending;
+  while (*link != session) link = &(*link)->next_pending;
+  *link = session->next_pending;
+  session->pending = 0;
+}
+
+/* Captures gdk GDK_FOCUS_CHANGE event for keeping track of session window order.
+ * Also use to check focus-in active port has been externally changed. */
+/* Any click on window header will send a double event of TRUE.
+ * Actually sends focus out, focus in, focus out, focus in */
+/* guess need to attach "click" for headerbar, but noway to get headerbar widget */
+static gboolean
+session_reorder(GtkWidget *widget, GdkEvent *event, LCISession *session) {
+
+    // moved foreground, all above it move back by being below it
+  if (event->type == GDK_FOCUS_CHANGE) {
+      // want only 1 focus_change.in when header clicked
+      // note change by click on any part other than header sends once
+      // repeats fold in queue
+      // deferred interface can't wait any longer
+    session_realize(session);
+    session->used = g_get_monotonic_time();
+    session_focused = session;
+    session_queue(session, SESSION_ORDER);
+  }
+    // need false else text caret won't show
+  return FALSE;
 }
 
 /* Captures gdk GDK_CONFIGURE and GDK_WINDOW_STATE event
@@ -175,261 +1114,1535 @@ static gboolean
 session_update(GtkWidget *widget, GdkEvent *event, LCISession *session) {
 
   if (event->type == GDK_CONFIGURE) {
-    if (session->maximized == 0) {
-        // wayland will ignore these, gdk 0,0
-        // on x11 it will honor
-      session->pt_x = event->configure.x;
-      session->pt_y = event->configure.y - OS_HEADER_MARGIN;
-        // because of wayland, gdk wrong
-      //session->sz_x = event->configure.width;
-      //session->sz_y = event->configure.height;
-        // works for both
-      gtk_window_get_size(GTK_WINDOW(widget),
-                          &session->sz_x,
-                          &session->sz_y);
-    }
+      // wayland will ignore these, gdk 0,0
+      // on x11 it will honor
+    session->ev_x = event->configure.x;
+    session->ev_y = event->configure.y - OS_HEADER_MARGIN;
+    session_queue(session, SESSION_GEOMETRY);
   } else if (event->type == GDK_WINDOW_STATE) {
     int blocked = GDK_WINDOW_STATE_WITHDRAWN |
                   GDK_WINDOW_STATE_MAXIMIZED |
                   GDK_WINDOW_STATE_FULLSCREEN;
-    session->maximized = ((event->window_state.new_window_state & blocked) != 0);
+    session->ev_maximized
+            = ((event->window_state.new_window_state & blocked) != 0);
+    session_queue(session, SESSION_STATE);
   } else {
 puts("update GDK_ANY");
   }
   return FALSE;
 }
 
-/* A single save, or 'quit' save will always open file
- * in "w"rite mode. On 'quit' multiple sessions after
- * the first enter under "a"ppend.
- *  A header line is created noting session window placement.
- * Must use fact that, window closure sequence is last creation
- * to newest, not foreground to farest in background. In header
- * first output is the total session windows, then <space>
- * seperated forground to background positions. This is done
- * placing in a sequence from first created to last created.
- * This allows recreation by the second header number output
- * respresents the line number additional data found, based on
- * being the 1st of the numbers, and the actual number represents
- * the sequence recreation should occur to achieve fore to back
- * ground viewing.
- */
-static int
-session_save(FILE *wh, LCISession *session, char *mode) {
-    // want a header, current state of sessions
-  if (*mode == 'w') {
-      // walk sessions for sequence
-      // assumption: never more than 16 sessions 6*3+10*2+1=39+nsessions
-    char seqstr[42];
-    int pdx = 1, idx = nsessions - 1;
-      // <space> seperated numbers
-    memset(seqstr, ' ', sizeof(seqstr));
-    seqstr[41] = 0;
-      // write out total number of sessions
-    if (nsessions > 9) {
-      seqstr[pdx] = '1', pdx++;
-      seqstr[pdx] = (nsessions - 10) + '0', pdx++;
-    } else
-      seqstr[pdx] = nsessions + '0', pdx++;
-    pdx++;
-    do {
-        // since 0 == foreground, (nsessions - 1) == bottom-most
-        // position to be load order, bottom to top
-      int position = session_stack[idx]->order;
-      if (position > 9) {
-        seqstr[pdx] = '1', pdx++;
-        seqstr[pdx] = (position - 10) + '0', pdx++;
-      } else
-        seqstr[pdx] = position + '0', pdx++;
-      pdx++;
-      if ((--idx) < 0)  break;
-    } while (1);
-    seqstr[(pdx - 1)] = 0;
-    fprintf(wh, "#%s\n", seqstr);
-  }
-
-  fprintf(wh, "\"%s\"\n", session->session_file);
-  char *session_dir = strdup(session->session_file);
-  char *tptr = strrchr(session_dir, '/');
-  tptr[1] = 0;
-  mkdir(session_dir, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
-  free(session_dir);
-    // write to file in directory
-  FILE *sh = fopen(session->session_file, "w");
-  int response = GTK_RESPONSE_ACCEPT;
-  if (sh != NULL) {
-    fprintf(sh, "%d %d %d %d "
-//                "%d "
-                "\"%s\"\n",
-                 session->pt_x, session->pt_y,
-                 session->sz_x, session->sz_y,
-                       // interface addition
-//                 session->pd_x,
-                 gtk_window_get_title(GTK_WINDOW(session->main_window)));
-//    if (lci_textport_flatten(sh, session) == GTK_RESPONSE_CANCEL)
-//      response = GTK_RESPONSE_CANCEL;
-//    lci_treeport_flatten(sh, session);
-    fclose(sh);
-  }
-  if (response == GTK_RESPONSE_CANCEL)
-    printf("response return is cancel\n");
-  return response;
+/* Recent catalog, every session ever opened, see recent_catalog.h.
+ * Read and indexed off main thread from start up, handed to main
+ * loop when done. Sessions are noted as their snapshots are taken,
+ * saved with master. Notes made while loading are queued, applied
+ * on hand over; a master saved meanwhile leaves catalog file as is.
+ * Only quit waits for loader, there being no later save.
+ */
+typedef struct _LciRecentNote {
+  char      *path;
+  char      *name;                // NULL to forget 'path'
+  int32_t    geometry[4];
+  gint64     last_used;
+} LCIRecentNote;
+
+static LCIRecent *recent;
+static GThread *recent_loader;
+static GArray *recent_queue;        // LCIRecentNote, while loading
+
+static gboolean recent_loaded(gpointer);
+
+static gpointer
+recent_load(gpointer data) {
+
+  LCIRecent *loaded = recent_open(data);
+  g_free(data);
+  g_idle_add(recent_loaded, loaded);
+  return loaded;
+}
+
+static void
+recent_load_start(void) {
+
+  char *catalog_file = g_strconcat(master_file, RECENT_SUFFIX, NULL);
+  recent_loader = g_thread_new("recent", recent_load, catalog_file);
+}
+
+static void
+recent_take(LCIRecent *loaded) {
+
+  recent = loaded;
+  if (recent_queue == NULL)  return;
+  for (guint idx = 0; idx < recent_queue->len; idx++) {
+    LCIRecentNote *note = &g_array_index(recent_queue, LCIRecentNote, idx);
+    if (note->name != NULL)
+      recent_note(recent, note->path, note->name,
+                          note->geometry, note->last_used);
+    else
+      recent_forget(recent, note->path);
+    g_free(note->path);
+    g_free(note->name);
+  }
+  g_array_free(recent_queue, TRUE);
+  recent_queue = NULL;
+}
+
+static gboolean
+recent_loaded(gpointer data) {
+
+    // not when quit already waited for it
+  if (recent_loader != NULL) {
+      // has returned, or is about to
+    g_thread_join(recent_loader);
+    recent_loader = NULL;
+    recent_take(data);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+  // quit only, main thread otherwise never waits on loader
+static void
+recent_wait(void) {
+
+  if (recent != NULL)  return;
+  if (recent_loader == NULL)
+    recent_load_start();
+  LCIRecent *loaded = g_thread_join(recent_loader);
+  recent_loader = NULL;
+  recent_take(loaded);
+}
+
+  // 'name' NULL to forget
+static void
+session_recent_note(const char *path, const char *name,
+                    const int32_t *geometry, gint64 last_used) {
+
+  if (recent != NULL) {
+    if (name != NULL)
+      recent_note(recent, path, name, geometry, last_used);
+    else
+      recent_forget(recent, path);
+    return;
+  }
+  if (recent_queue == NULL)
+    recent_queue = g_array_new(FALSE, TRUE, sizeof(LCIRecentNote));
+  LCIRecentNote note = { g_strdup(path), g_strdup(name), { 0 }, last_used };
+  if (geometry != NULL)
+    memcpy(note.geometry, geometry, sizeof(note.geometry));
+  g_array_append_val(recent_queue, note);
+}
+
+  // open recent, quick switch, nothing found while loading
+int
+lci_recent_find(const char *query, LCIRecentEntry **found, int max) {
+  return (recent != NULL) ? recent_find(recent, query, found, max) : 0;
+}
+
+/* Takes session's data, its position/size and title. Interface
+ * flatten routines add their sections here.
+ */
+static int
+session_snapshot(LCISession *session, LCISnapshot *snap) {
+
+  int response = GTK_RESPONSE_ACCEPT;
+  snap->session_file = intern_ref(session->session_file);
+  snap->title = intern_ref(session->title);
+  snap->geometry[0] = session->pt_x, snap->geometry[1] = session->pt_y;
+  snap->geometry[2] = session->sz_x, snap->geometry[3] = session->sz_y;
+  session_recent_note(snap->session_file, snap->title,
+                      snap->geometry, (g_get_real_time() / G_USEC_PER_SEC));
+                     // interface addition
+//  snap->pd_x = session->pd_x;
+  snap->text = NULL;
+  snap->text_len = 0;
+  snap->keep_text = 0;
+  if (lci_textport_flatten(snap, session) == GTK_RESPONSE_CANCEL)
+    response = GTK_RESPONSE_CANCEL;
+//  lci_treeport_flatten(snap, session);
+  return response;
+}
+
+/* Persistence worker. Disk is never touched from main thread when
+ * saving: sessions are taken as LCISnapshot, which own their data,
+ * and handed to a single worker thread. Being one thread, commits
+ * are written in the order handed over and never overlap, journal
+ * writes and compaction included. A stalled mount then stalls only
+ * the worker. Once written, the commit's 'done' is run back on main
+ * thread.
+ */
+typedef struct _LciPersist LCIPersist;
+typedef void (*LCIPersistDone)(LCIPersist *persist);
+
+  // what worker does to journal ahead of a commit
+enum {
+  PERSIST_JOURNAL_KEEP,
+  PERSIST_JOURNAL_ASIDE,          // to JOURNAL_OLD_SUFFIX, master's commit
+  PERSIST_JOURNAL_DROP            // both removed
+};
+
+struct _LciPersist {
+  LCISnapshot     *snaps;
+  int              count;
+  int              failed;        // set by worker, store_commit()'s findings
+  char            *records;       // journal records, appended first, or NULL
+  size_t           records_len;
+  int              journal;       // PERSIST_JOURNAL_*
+  gint64           start;         // trace_now() of hand over
+  const char      *span;          // trace name of write
+  LCIPersistDone   done;          // main thread, may be NULL
+  const char      *master;        // master_file, NULL when session files only
+  void            *fonts;         // font cache, with master, or NULL
+  size_t           fonts_len;
+  void            *recent;        // recent catalog, with master, or NULL
+  size_t           recent_len;
+  LCIRestore       reload;        // worker decodes, path NULL for none
+  const char      *reloading;     // session reloaded, interned
+  LCITextportRestore *shared;     // its view, 'reload' being owner's file
+  int              capacity;      // of 'snaps', kept while spare
+  LCIPersist      *next;          // on 'persist_spare'
+};
+
+static GThreadPool *persist_pool;
+static GMutex persist_lock;
+static GCond persist_cond;
+static int persist_pending;         // handed over, not yet written
+
+/* Commit records. Carved PERSIST_SLAB at a time, as session records
+ * are, and back on 'persist_spare' once their 'done' has run. Each
+ * keeps its snapshot array, grown only when a commit has more
+ * sessions than it held, so saving does not go to malloc for either.
+ * Main thread alone takes and returns them.
+ */
+#define PERSIST_SLAB  8
+
+static LCIPersist *persist_spare;
+
+static LCIPersist *
+persist_new(int count, const char *span, LCIPersistDone done) {
+
+  if (persist_spare == NULL) {
+    LCIPersist *slab = calloc(PERSIST_SLAB, sizeof(LCIPersist));
+    for (int idx = 0; idx < PERSIST_SLAB; idx++) {
+      slab[idx].next = persist_spare;
+      persist_spare = &slab[idx];
+    }
+  }
+  LCIPersist *persist = persist_spare;
+  persist_spare = persist->next;
+  LCISnapshot *snaps = persist->snaps;
+  int capacity = persist->capacity;
+  if (count > capacity) {
+    free(snaps);
+    snaps = malloc(count * sizeof(LCISnapshot));
+    capacity = count;
+  }
+  memset(persist, 0, sizeof(LCIPersist));
+  persist->snaps = snaps;
+  persist->capacity = capacity;
+  persist->start = trace_now();
+  persist->span = span;
+  persist->done = done;
+  return persist;
+}
+
+static void
+persist_dispose(LCIPersist *persist) {
+
+  snapshot_clear(persist->snaps, persist->count);
+  free(persist->records);
+  free(persist->fonts);
+  g_free(persist->recent);
+  free(persist->reload.path);
+  free(persist->reload.stored_title);
+  textport_restore_free(persist->reload.text);
+  textport_restore_free(persist->shared);
+  intern_release(persist->reloading);
+  persist->next = persist_spare;
+  persist_spare = persist;
+}
+
+static gboolean
+persist_complete(gpointer data) {
+
+  LCIPersist *persist = data;
+  for (int idx = 0; idx < persist->count; idx++)
+    if (persist->snaps[idx].failed)
+      printf("ERROR: unable to save session %s\n", persist->snaps[idx].session_file);
+  if (persist->failed & STORE_COMMIT_MASTER)
+    puts("ERROR: unable to save sessions list");
+  if (persist->done != NULL)
+    persist->done(persist);
+  persist_dispose(persist);
+  return G_SOURCE_REMOVE;
+}
+
+static void journal_before(LCIPersist *);
+static void journal_after(LCIPersist *);
+
+  // beside master, made once by persist_master(), worker's to write
+static char *master_fonts, *master_recent;
+
+static void
+persist_worker(gpointer data, gpointer user_data) {
+
+  (void)user_data;
+  LCIPersist *persist = data;
+  gint64 start = trace_now();
+  journal_before(persist);
+    // after any write of it handed over before
+  if (persist->reload.path != NULL)
+    textport_unflatten(&persist->reload);
+  if ((persist->count != 0) || (persist->master != NULL)) {
+    persist->failed = store_commit(persist->snaps, persist->count,
+                          persist->master);
+    journal_after(persist);
+  }
+  if ((persist->fonts != NULL) && (!(persist->failed & STORE_COMMIT_MASTER)))
+    font_cache_write(master_fonts, persist->fonts, persist->fonts_len);
+  if ((persist->recent != NULL) && (!(persist->failed & STORE_COMMIT_MASTER)))
+    recent_write(master_recent, persist->recent, persist->recent_len);
+  trace_span(persist->span, start,
+             ((persist->count == 1) ? persist->snaps[0].session_file : NULL));
+  g_idle_add(persist_complete, persist);
+  g_mutex_lock(&persist_lock);
+  if ((--persist_pending) == 0)
+    g_cond_broadcast(&persist_cond);
+  g_mutex_unlock(&persist_lock);
+}
+
+  // files kept beside master go with it
+static void
+persist_master(LCIPersist *persist) {
+
+  if (master_fonts == NULL) {
+    master_fonts = g_strconcat(master_file, FONT_CACHE_SUFFIX, NULL);
+    master_recent = g_strconcat(master_file, RECENT_SUFFIX, NULL);
+  }
+  persist->master = master_file;
+  persist->fonts = font_cache_flatten(&persist->fonts_len);
+  persist->recent = (recent != NULL)
+                      ? recent_flatten(recent, &persist->recent_len) : NULL;
+}
+
+static void
+persist_submit(LCIPersist *persist) {
+
+  if (persist_pool == NULL)
+    persist_pool = g_thread_pool_new(persist_worker, NULL, 1, FALSE, NULL);
+  g_mutex_lock(&persist_lock);
+  persist_pending++;
+  g_mutex_unlock(&persist_lock);
+  g_thread_pool_push(persist_pool, persist, NULL);
+}
+
+  // blocks until all handed over are on disk, their 'done' still queued
+static void
+persist_wait(void) {
+
+  g_mutex_lock(&persist_lock);
+  while (persist_pending != 0)
+    g_cond_wait(&persist_cond, &persist_lock);
+  g_mutex_unlock(&persist_lock);
+}
+
+/* A commit's sessions are gathered in SESSION_BATCH_LOCAL entries on
+ * stack, more than that in an array of their own. Not one shared
+ * array, a flatten asking the user runs main loop under a commit.
+ */
+#define SESSION_BATCH_LOCAL 64
+
+/* Hands 'batch' sessions' files, and when 'with_master' the master
+ * file listing them, to the worker as a single commit.
+ * Snapshots are taken here, on main thread, so an interface flatten
+ * can still ask the user. Return of GTK_RESPONSE_CANCEL signals user
+ * canceled due to unsaved changes, nothing is written. Otherwise
+ * GTK_RESPONSE_ACCEPT, the write happens later and 'done' gets its
+ * outcome. A failure to write is reported, and replaces only that
+ * file, its session then is kept in journal.
+ */
+static int
+session_commit(LCISession **batch, int count, int with_master,
+                                              LCIPersistDone done) {
+
+  LCIPersist *persist = persist_new(count,
+               (with_master ? "session_save_all" : "session_save"), done);
+  textport_commit_start();
+
+  while (persist->count < count) {
+    int response = session_snapshot(batch[persist->count],
+                                    &persist->snaps[persist->count]);
+    persist->count++;
+    if (response == GTK_RESPONSE_CANCEL) {
+      persist_dispose(persist);
+      printf("response return is cancel\n");
+      return response;
+    }
+  }
+  if (with_master) {
+    persist_master(persist);
+    persist->journal = PERSIST_JOURNAL_ASIDE;
+  }
+    // saved as of now, later changes dirty again
+  for (int idx = 0; idx < count; idx++) {
+    batch[idx]->dirty = 0;
+    batch[idx]->usage.written += store_session_size(&persist->snaps[idx]);
+  }
+  persist_submit(persist);
+  return GTK_RESPONSE_ACCEPT;
+}
+
+/* Geometry journal. Between saves, changes get appended to a journal
+ * beside master rather than rewriting files. Restore replays it over
+ * master and session files, the snapshot. Records are gathered for
+ * JOURNAL_DELAY_MS and handed to the persistence worker, which puts
+ * them out in one write(), without a sync: a crash of the process
+ * loses nothing written, a torn tail from power loss fails its check
+ * and ends replay. Only the worker opens, writes, moves or removes
+ * journal files, in order with commits.
+ *   Compaction folds journal into a new snapshot, as does quit.
+ * Journal is first moved aside to JOURNAL_OLD_SUFFIX, a fresh one
+ * takes records meanwhile, and the aside one is only removed once the
+ * new master is in place. Replay reads aside then current, so an
+ * interrupted compaction loses nothing.
+ */
+#define JOURNAL_DELAY_MS        1000
+#define JOURNAL_COMPACT_SECONDS 60
+#define JOURNAL_COMPACT_SIZE    (64 * 1024)
+
+static char *journal_file, *journal_old;
+static size_t journal_size;         // bytes handed over since moved aside
+static char *journal_buffer;        // records awaiting hand over
+static size_t journal_used, journal_capacity;
+static guint journal_source;
+static int journal_compacting;       // handed to persistence worker
+static int journal_fd = -1;         // worker's
+
+  // return bytes added to journal
+static size_t
+journal_append(uint32_t type, const char *path,
+               const char *title, const int32_t *geometry) {
+
+  size_t total = journal_record(NULL, type, path, title, geometry);
+  if ((journal_used + total) > journal_capacity) {
+    do journal_capacity = (journal_capacity == 0) ? 4096 : (journal_capacity * 2);
+    while ((journal_used + total) > journal_capacity);
+    journal_buffer = realloc(journal_buffer, journal_capacity);
+  }
+  journal_record((journal_buffer + journal_used), type, path, title, geometry);
+  journal_used += total;
+  return total;
+}
+
+/* Records changes session_flush() applied. Bottom up, so replay of
+ * raises leaves them in same order: every session raised since last
+ * gather is above every session that was not.
+ */
+static void
+journal_gather(void) {
+
+  for (LCISession *session = session_bottom; session != NULL;
+                                             session = session->above) {
+    if (session->unlogged == 0)  continue;
+    int32_t geometry[4] = { session->pt_x, session->pt_y,
+                            session->sz_x, session->sz_y };
+    if (session->unlogged & SESSION_GEOMETRY)
+      session->usage.written += journal_append(JOURNAL_GEOMETRY,
+                                    session->session_file, NULL, geometry);
+    if (session->unlogged & SESSION_ORDER)
+      session->usage.written += journal_append(JOURNAL_RAISE,
+                                    session->session_file, NULL, NULL);
+    session->unlogged = 0;
+  }
+}
+
+  // worker, records onto end of journal, opened with a header when new
+static void
+journal_out(const char *records, size_t length) {
+
+  if (journal_fd < 0) {
+    journal_fd = open(journal_file,
+                      (O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC), 0644);
+    struct stat st;
+    int failed = (journal_fd < 0) || (fstat(journal_fd, &st) != 0);
+    if ((!failed) && (st.st_size == 0)) {
+      LCIJournalHeader header = { JOURNAL_MAGIC, JOURNAL_VERSION };
+      if (write(journal_fd, &header, sizeof(header)) != sizeof(header)) {
+        failed = 1;
+        if (ftruncate(journal_fd, 0) != 0)
+          unlink(journal_file);
+      }
+    }
+    if (failed) {
+      puts("ERROR: unable to write session journal");
+      if (journal_fd >= 0)  close(journal_fd);
+      journal_fd = -1;
+      return;
+    }
+  }
+  size_t done = 0;
+  while (done < length) {
+    ssize_t wrote = write(journal_fd, (records + done), (length - done));
+    if (wrote <= 0) {
+      puts("ERROR: unable to write session journal");
+      break;
+    }
+    done += wrote;
+  }
+}
+
+/* Worker, an aside journal left by a failed compaction takes the
+ * current one's records. Current is only removed once copied whole,
+ * a partial copy is cut off again.
+ */
+static void
+journal_concat(void) {
+
+  int rfd = open(journal_file, (O_RDONLY | O_CLOEXEC));
+  if (rfd < 0)  return;
+  int wfd = open(journal_old, (O_WRONLY | O_APPEND | O_CLOEXEC));
+  struct stat st;
+  int copied = (wfd >= 0) && (fstat(wfd, &st) == 0);
+  if (copied) {
+    char block[8192];
+    ssize_t got;
+    lseek(rfd, sizeof(LCIJournalHeader), SEEK_SET);
+    while ((got = read(rfd, block, sizeof(block))) > 0) {
+      if (write(wfd, block, got) != got) {
+        copied = 0;
+        break;
+      }
+    }
+    if (got < 0)  copied = 0;
+    if ((!copied) && (ftruncate(wfd, st.st_size) != 0))
+      puts("ERROR: unable to restore session journal");
+  }
+  close(rfd);
+  if (wfd >= 0)  close(wfd);
+  if (copied)
+    unlink(journal_file);
+  else
+    puts("ERROR: unable to fold session journal");
+}
+
+  // worker, ahead of a commit
+static void
+journal_before(LCIPersist *persist) {
+
+  if (persist->records != NULL)
+    journal_out(persist->records, persist->records_len);
+  if (persist->journal == PERSIST_JOURNAL_KEEP)  return;
+  if (journal_fd >= 0) {
+    close(journal_fd);
+    journal_fd = -1;
+  }
+  if (persist->journal == PERSIST_JOURNAL_DROP) {
+    unlink(journal_file);
+    unlink(journal_old);
+  } else if (access(journal_old, F_OK) == 0) {
+    journal_concat();
+  } else {
+    rename(journal_file, journal_old);
+  }
+}
+
+/* Worker, after a commit. Once master has it, aside journal goes,
+ * or only keeps sessions whose files failed. Kept whole when master
+ * failed, it replays over previous master.
+ */
+static void
+journal_after(LCIPersist *persist) {
+
+  if (persist->journal != PERSIST_JOURNAL_ASIDE)  return;
+  if (persist->failed == 0)
+    unlink(journal_old);
+  else if (persist->failed == STORE_COMMIT_SESSIONS)
+    journal_unsaved(journal_old, persist->snaps, persist->count);
+}
+
+  // hands gathered records to worker
+static gboolean
+journal_write(gpointer data) {
+
+  (void)data;
+  journal_source = 0;
+  journal_gather();
+  if (journal_used == 0)  return G_SOURCE_REMOVE;
+  LCIPersist *persist = persist_new(0, "journal_write", NULL);
+  persist->records = journal_buffer;
+  persist->records_len = journal_used;
+  journal_size += journal_used;
+  journal_buffer = NULL;
+  journal_used = journal_capacity = 0;
+  persist_submit(persist);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+journal_schedule(void) {
+
+  if (journal_source == 0)
+    journal_source = g_timeout_add(JOURNAL_DELAY_MS, journal_write, NULL);
+}
+
+static void
+journal_write_now(void) {
+
+  if (journal_source != 0)
+    g_source_remove(journal_source);
+  journal_write(NULL);
+}
+
+  // session added or removed, earlier changes must come first
+static void
+journal_note(uint32_t type, LCISession *session) {
+
+  int32_t geometry[4] = { session->pt_x, session->pt_y,
+                          session->sz_x, session->sz_y };
+  journal_gather();
+  session->usage.written += journal_append(type, session->session_file,
+                      ((type == JOURNAL_OPEN) ? session->title : NULL), geometry);
+  journal_schedule();
+}
+
+/* Everything is in a snapshot, records not yet out are dropped, and
+ * both journals removed once worker gets to it.
+ */
+static void
+journal_reset(void) {
+
+  if (journal_source != 0) {
+    g_source_remove(journal_source);
+    journal_source = 0;
+  }
+  journal_size = journal_used = 0;
+  LCIPersist *persist = persist_new(0, "journal_reset", NULL);
+  persist->journal = PERSIST_JOURNAL_DROP;
+  persist_submit(persist);
+}
+
+  // new master is in place, worker has removed aside journal
+static void
+journal_compact_done(LCIPersist *persist) {
+
+  (void)persist;
+  journal_compacting = 0;
+}
+
+static void
+journal_compact_start(void) {
+
+  if (journal_compacting || (nsessions == 0))  return;
+
+  session_flush_now();
+    // records so far go out before journal is moved aside
+  journal_write_now();
+  journal_size = 0;
+
+    // interface flattening here would be of its own, non-interactive
+  LCIPersist *compact = persist_new(nsessions, "journal_compact",
+                                               journal_compact_done);
+  textport_commit_start();
+  for (LCISession *session = session_top; session != NULL;
+                                          session = session->below)
+    session_snapshot(session, &compact->snaps[compact->count++]);
+  persist_master(compact);
+  compact->journal = PERSIST_JOURNAL_ASIDE;
+  journal_compacting = 1;
+  persist_submit(compact);
+}
+
+static gboolean
+journal_compact_check(gpointer data) {
+
+  (void)data;
+  if ((journal_size + journal_used) > JOURNAL_COMPACT_SIZE)
+    journal_compact_start();
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+journal_compact_idle(gpointer data) {
+
+  (void)data;
+  journal_compact_start();
+  return G_SOURCE_REMOVE;
+}
+
+static void
+journal_init(void) {
+
+  journal_file = g_strconcat(master_file, JOURNAL_SUFFIX, NULL);
+  journal_old = g_strconcat(master_file, JOURNAL_OLD_SUFFIX, NULL);
+  g_timeout_add_seconds(JOURNAL_COMPACT_SECONDS, journal_compact_check, NULL);
+}
+
+static int session_pool_put(LCISession *);
+
+/* Removes window, releases its slot and place in stacking
+ * order, and frees resources of closing session. Window may
+ * go back to the window pool.
+ */
+static void
+session_remove(LCISession *session) {
+
+  gint64 start = trace_now();
+  session_dequeue(session);
+  session_unregister(session);
+  trace_span("session_close", start, session->session_file);
+  session_index_close(session);
+  lci_textport_reset(session);
+  intern_release(session->project_name);
+  intern_release(session->session_file);
+  intern_release(session->title);
+  if (!session_pool_put(session)) {
+    gtk_widget_destroy(session->main_window);
+    session_dispose(session);
+  }
+}
+
+/* A user cancel puts back windows that were on their way out. */
+static void
+session_close_cancel(void) {
+
+  for (LCISession *session = session_top; session != NULL;
+                                          session = session->below) {
+    if (session->closing) {
+      session->closing = 0;
+      gtk_widget_show(session->main_window);
+    }
+  }
+}
+
+static void session_main_quit(void);
+
+/* Set from quit's commit until its write is out. A session made in
+ * between, by another instance's launch, is not in that commit.
+ * SESSION_QUIT_HELD when such a launch took a hold on application
+ * to outlive this quit, see session_app_revive().
+ */
+#define SESSION_QUIT_HELD 2
+static int session_quitting;
+
+  // quit's write is out, only now may the process end
+static void
+session_quit_done(LCIPersist *persist) {
+
+    // journal went aside with quit's commit, worker settled it,
+    // any session made since is in the fresh one
+  session_quitting = 0;
+  trace_span("session_quit", persist->start, NULL);
+  session_main_quit();
+}
+
+/* Saves every session and master in one commit, then ends.
+ * Master lists sessions foreground to background. Windows go at
+ * once, event tracker ends when the worker has written them.
+ */
+static int
+session_quit_commit(void) {
+
+  session_flush_now();
+    // records so far go out before journal is moved aside
+  journal_write_now();
+    // last master written, catalog must be with it
+  recent_wait();
+  LCISession *local[SESSION_BATCH_LOCAL];
+  LCISession **batch = (nsessions <= SESSION_BATCH_LOCAL) ? local
+                       : malloc(nsessions * sizeof(LCISession *));
+  int count = 0;
+  for (LCISession *session = session_top; session != NULL;
+                                          session = session->below)
+    batch[count++] = session;
+  int response = session_commit(batch, count, 1, session_quit_done);
+  if (batch != local)  free(batch);
+  if (response == GTK_RESPONSE_CANCEL) {
+    session_close_cancel();
+    return GTK_RESPONSE_CANCEL;
+  }
+  journal_size = 0;
+  session_quitting = 1;
+    // make nsessions 0, session_quit_done() may be long in coming
+  while (session_top != NULL)
+    session_remove(session_top);
+  return GTK_RESPONSE_ACCEPT;
+}
+
+/* Hibernation. A background session left alone for 'hibernate_idle'
+ * (LCI_HIBERNATE_MINUTES, 0 for never), or any but foreground when
+ * memory monitor warns, is saved and has its interface torn down:
+ * tree area, its index and text area go, its window stays on screen
+ * with title and geometry, as a restored session before realization.
+ * Raising it realizes it again. Back of stacking order goes first.
+ * Document is let go once its session file is written, edits and
+ * all, see session_hibernate_done(), and read back on realization.
+ * A save meanwhile keeps the file's textport section as it is.
+ */
+#define HIBERNATE_IDLE_MINUTES    30
+#define HIBERNATE_CHECK_SECONDS   60
+#define HIBERNATE_PRESSURE_MS     60000     // spared on a low warning
+static gint64 hibernate_idle = (gint64)HIBERNATE_IDLE_MINUTES * 60 * G_USEC_PER_SEC;
+
+static void
+session_teardown(LCISession *session) {
+
+  gint64 start = trace_now();
+  session_index_close(session);
+  gtk_widget_destroy(session->paned);
+  g_object_unref(session->tree_model);
+  session->paned = NULL;
+  session->tree_view = NULL;
+  session->editor_box = NULL;
+  session->tree_model = NULL;
+  session->realized = 0;
+  session->hibernated = 1;
+  trace_span("session_hibernate", start, session->session_file);
+}
+
+/* Hibernated session's file is written, its document goes unless
+ * raised meanwhile, or not written. Another session showing it
+ * keeps it open.
+ */
+static void
+session_hibernate_done(LCIPersist *persist) {
+
+  for (int idx = 0; idx < persist->count; idx++) {
+    if (persist->snaps[idx].failed)  continue;
+    LCISession *session = session_top;
+    while ( (session != NULL)
+           && (session->session_file != persist->snaps[idx].session_file) )
+      session = session->below;
+    if ( (session == NULL) || session->realized || (!session->hibernated)
+        || (session->document == NULL) )
+      continue;
+    lci_textport_reset(session);
+    session->text_stored = 1;
+  }
+}
+
+static void textport_reload_done(LCIPersist *);
+
+static void
+textport_reload_submit(const char *session_file, const char *path,
+                                              LCITextportRestore *shared) {
+
+  LCIPersist *persist = persist_new(0, "textport_reload", textport_reload_done);
+  persist->reload.path = strdup(path);
+  persist->reloading = intern_ref(session_file);
+  persist->shared = shared;
+  persist_submit(persist);
+}
+
+/* Decoded, session's document is attached unless it closed, or got
+ * a document meanwhile. A shared one's owner not open here has its
+ * file decoded next, the same way.
+ */
+static void
+textport_reload_done(LCIPersist *persist) {
+
+  LCISession *session = session_top;
+  while ((session != NULL) && (session->session_file != persist->reloading))
+    session = session->below;
+  if ( (session == NULL) || (!session->text_stored)
+      || (session->document != NULL) )
+    return;
+  LCITextportRestore *restore = persist->shared;
+  if (restore != NULL) {
+    restore->document = textport_owner_found(restore, persist->reload.text);
+    persist->shared = NULL;
+  } else {
+    restore = persist->reload.text;
+    textport_register(restore, persist->reloading);
+    if ((restore != NULL) && (restore->document == NULL)) {
+      restore->document = document_find(restore->key);
+      if (restore->document == NULL) {
+        textport_reload_submit(session->session_file, restore->owner, restore);
+        persist->reload.text = NULL;
+        return;
+      }
+    }
+  }
+  persist->reload.text = NULL;
+  textport_attach(session, restore);
+  session->text_stored = 0;
+}
+
+  // hibernated session's document, back from its session file
+static void
+textport_reload(LCISession *session) {
+  textport_reload_submit(session->session_file, session->session_file, NULL);
+}
+
+  // sessions unused for 'idle' µs, from back, saved in one commit
+static void
+session_hibernate(gint64 idle) {
+
+  gint64 now = g_get_monotonic_time();
+  LCISession *local[SESSION_BATCH_LOCAL];
+  LCISession **batch = (nsessions <= SESSION_BATCH_LOCAL) ? local
+                       : malloc(nsessions * sizeof(LCISession *));
+  int count = 0;
+  for (LCISession *session = session_bottom; session != session_top;
+                                             session = session->above)
+    if ( session->realized && (!session->closing)
+        && ((now - session->used) >= idle) )
+      batch[count++] = session;
+  if ( (count != 0)
+      && (session_commit(batch, count, 0, session_hibernate_done)
+                                               == GTK_RESPONSE_ACCEPT) )
+    for (int idx = 0; idx < count; idx++)
+      session_teardown(batch[idx]);
+  if (batch != local)  free(batch);
+}
+
+static gboolean
+hibernate_check(gpointer data) {
+
+  (void)data;
+  session_hibernate(hibernate_idle);
+  return G_SOURCE_CONTINUE;
+}
+
+#if GLIB_CHECK_VERSION(2, 64, 0)
+static void
+hibernate_pressure(GMemoryMonitor *monitor,
+                   GMemoryMonitorWarningLevel level, gpointer data) {
+
+  (void)monitor, (void)data;
+  session_hibernate((level >= G_MEMORY_MONITOR_WARNING_LEVEL_MEDIUM)
+                    ? 0 : ((gint64)HIBERNATE_PRESSURE_MS * 1000));
+}
+#endif
+
+static void
+hibernate_init(void) {
+
+  const char *env = g_getenv("LCI_HIBERNATE_MINUTES");
+  if (env != NULL)
+    hibernate_idle = (gint64)(g_ascii_strtod(env, NULL) * 60 * G_USEC_PER_SEC);
+  if (hibernate_idle > 0)
+    g_timeout_add_seconds(HIBERNATE_CHECK_SECONDS, hibernate_check, NULL);
+#if GLIB_CHECK_VERSION(2, 64, 0)
+    // kept for life of process
+  GMemoryMonitor *monitor = g_memory_monitor_dup_default();
+  g_signal_connect(monitor, "low-memory-warning",
+                            G_CALLBACK(hibernate_pressure), NULL);
+#endif
+}
+
+/* Gala WM sends a 'delete' for each window on its 'Close All'.
+ * Closes are held until no further 'delete' arrives for
+ * CLOSE_BURST_MS. If by then every session is closing, it was a
+ * 'quit' and all are committed together with the master.
+ * Otherwise only the closing sessions' files are saved.
+ */
+#define CLOSE_BURST_MS 250
+static guint close_burst = 0;
+
+static gboolean
+session_close_burst(gpointer data) {
+
+  (void)data;
+  close_burst = 0;
+  session_flush_now();
+
+  LCISession *local[SESSION_BATCH_LOCAL];
+  LCISession **batch = (nsessions <= SESSION_BATCH_LOCAL) ? local
+                       : malloc(nsessions * sizeof(LCISession *));
+  int count = 0;
+  for (LCISession *session = session_top; session != NULL;
+                                          session = session->below)
+    if (session->closing)  batch[count++] = session;
+
+  if (count == nsessions) {
+    session_quit_commit();
+  } else if (session_commit(batch, count, 0, NULL) == GTK_RESPONSE_CANCEL) {
+    session_close_cancel();
+  } else {
+    for (int idx = 0; idx < count; idx++) {
+      journal_note(JOURNAL_CLOSE, batch[idx]);
+      session_remove(batch[idx]);
+    }
+  }
+  if (batch != local)  free(batch);
+  return G_SOURCE_REMOVE;
+}
+
+/* 'delete-event' handler. Window is hidden at once, its save and
+ * removal wait on session_close_burst().
+ */
+gboolean
+lci_session_close(GtkWidget *widget, GdkEvent *event, LCISession *session) {
+
+  (void)widget, (void)event;
+
+  session->closing = 1;
+  gtk_widget_hide(session->main_window);
+  if (close_burst != 0)
+    g_source_remove(close_burst);
+  close_burst = g_timeout_add(CLOSE_BURST_MS, session_close_burst, NULL);
+    // session_remove() destroys the window
+  return TRUE;
+}
+
+/* gdk, and window managers lack support for multi-window apps */
+void
+lci_session_quit(LCISession *top_session) {
+
+  (void)top_session;
+
+    // a pending 'Close All' burst is folded into this quit
+  if (close_burst != 0) {
+    g_source_remove(close_burst);
+    close_burst = 0;
+  }
+  session_quit_commit();
+    // reaches here on a cancel of save by user in 'close'
+}
+
+/* Assign a name to new editor session */
+static char *
+session_name(void) {
+
+  if ((++total_created_sessions) == 1)
+    return name_of_session;
+  sprintf(&name_of_session[NOS_APPEND],
+               " - Session %d", total_created_sessions);
+  return name_of_session;
+}
+
+/* Handler latency. Signal handlers of a session's window are all
+ * dispatched on the one main loop, a slow one stalls every window.
+ * Each connects through a timing wrapper keeping a histogram, in
+ * power of 2 microsecond buckets, per handler. A dispatch over
+ * 'handler_slow' is logged with its session and event. Statistics
+ * print on SIGUSR1, ahead of resource usage, see usage_dump():
+ *   kill -USR1 `pidof windows`
+ * LCI_SLOW_HANDLER_MS sets the threshold, 0 turns logging off.
+ */
+#define HANDLER_SLOW_MS   16          // a frame at 60Hz
+#define HANDLER_BUCKETS   24          // last holds 2^22 µs and over
+
+typedef gboolean (*LCIHandlerFunc)(GtkWidget *, GdkEvent *, LCISession *);
+
+enum {
+  HANDLER_CLOSE,
+  HANDLER_UPDATE,
+  HANDLER_KEYPRESS,
+  HANDLER_REORDER,
+  HANDLERS
+};
+
+typedef struct _LciHandlerStats {
+  const char  *name;
+  guint64      count;
+  gint64       total, max;            // µs
+  guint64      buckets[HANDLER_BUCKETS];
+} LCIHandlerStats;
+
+static LCIHandlerStats handler_stats[HANDLERS] = {
+  [HANDLER_CLOSE]     = { "lci_session_close" },
+  [HANDLER_UPDATE]    = { "session_update" },
+  [HANDLER_KEYPRESS]  = { "session_keypress" },
+  [HANDLER_REORDER]   = { "session_reorder" },
+};
+static gint64 handler_slow = HANDLER_SLOW_MS * 1000;
+
+static const char *
+handler_event_name(GdkEvent *event) {
+
+  switch (event->type) {
+    case GDK_DELETE:        return "delete";
+    case GDK_CONFIGURE:     return "configure";
+    case GDK_WINDOW_STATE:  return "window-state";
+    case GDK_KEY_PRESS:     return "key-press";
+    case GDK_FOCUS_CHANGE:  return "focus-change";
+    default:                return "other";
+  }
+}
+
+static gboolean
+handler_dispatch(int which, LCIHandlerFunc func,
+                 GtkWidget *widget, GdkEvent *event, LCISession *session) {
+
+    // a pooled shell is no session
+  if (session->session_file == NULL)  return FALSE;
+  gint64 start = g_get_monotonic_time();
+  gboolean handled = func(widget, event, session);
+  gint64 elapsed = g_get_monotonic_time() - start;
+
+  LCIHandlerStats *stats = &handler_stats[which];
+  int bucket = 0;
+  while ((bucket < (HANDLER_BUCKETS - 1)) && ((elapsed >> bucket) != 0))
+    bucket++;
+  stats->buckets[bucket]++;
+  stats->count++;
+  session->usage.dispatches++;
+  session->usage.main_us += elapsed;
+  stats->total += elapsed;
+  if (elapsed > stats->max)  stats->max = elapsed;
+    // a close has hidden, but not yet freed, its session
+  if ((handler_slow > 0) && (elapsed >= handler_slow))
+    printf("SLOW: %s %" G_GINT64_FORMAT " us, %s on \"%s\"\n",
+           stats->name, elapsed, handler_event_name(event),
+           session->title);
+  return handled;
+}
+
+static gboolean
+handler_close(GtkWidget *widget, GdkEvent *event, LCISession *session) {
+  return handler_dispatch(HANDLER_CLOSE, lci_session_close,
+                                         widget, event, session);
+}
+
+static gboolean
+handler_update(GtkWidget *widget, GdkEvent *event, LCISession *session) {
+  return handler_dispatch(HANDLER_UPDATE, session_update,
+                                          widget, event, session);
+}
+
+  // session_keypress() takes its key event as such
+static gboolean
+handler_key_event(GtkWidget *widget, GdkEvent *event, LCISession *session) {
+  return session_keypress(widget, &event->key, session);
+}
+
+static gboolean
+handler_keypress(GtkWidget *widget, GdkEvent *event, LCISession *session) {
+  return handler_dispatch(HANDLER_KEYPRESS, handler_key_event,
+                                            widget, event, session);
+}
+
+static gboolean
+handler_reorder(GtkWidget *widget, GdkEvent *event, LCISession *session) {
+  return handler_dispatch(HANDLER_REORDER, session_reorder,
+                                           widget, event, session);
+}
+
+  // upper bound of bucket holding the 'percent' sample
+static gint64
+handler_percentile(LCIHandlerStats *stats, int percent) {
+
+  guint64 rank = ((stats->count * percent) + 99) / 100;
+  guint64 seen = 0;
+  int bucket;
+  for (bucket = 0; bucket < (HANDLER_BUCKETS - 1); bucket++) {
+    seen += stats->buckets[bucket];
+    if (seen >= rank)  break;
+  }
+  return (bucket == (HANDLER_BUCKETS - 1)) ? stats->max
+                                           : MIN(((gint64)1 << bucket), stats->max);
+}
+
+static gboolean
+handler_dump(gpointer data) {
+
+  (void)data;
+  printf("%-18s %10s %10s %10s %10s %10s\n",
+         "handler", "count", "mean us", "p50 us", "p99 us", "max us");
+  for (int idx = 0; idx < HANDLERS; idx++) {
+    LCIHandlerStats *stats = &handler_stats[idx];
+    if (stats->count == 0) {
+      printf("%-18s %10d\n", stats->name, 0);
+      continue;
+    }
+    printf("%-18s %10" G_GUINT64_FORMAT " %10" G_GINT64_FORMAT
+           " %10" G_GINT64_FORMAT " %10" G_GINT64_FORMAT " %10" G_GINT64_FORMAT "\n",
+           stats->name, stats->count, (gint64)(stats->total / stats->count),
+           handler_percentile(stats, 50), handler_percentile(stats, 99),
+           stats->max);
+    for (int bucket = 0; bucket < HANDLER_BUCKETS; bucket++) {
+      if (stats->buckets[bucket] == 0)  continue;
+      printf("  < %8" G_GINT64_FORMAT " us %10" G_GUINT64_FORMAT "\n",
+             ((gint64)1 << bucket), stats->buckets[bucket]);
+    }
+  }
+  fflush(stdout);
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+handler_init(void) {
+
+  const char *env = g_getenv("LCI_SLOW_HANDLER_MS");
+  if (env != NULL)
+    handler_slow = (gint64)(g_ascii_strtod(env, NULL) * 1000);
+}
+
+/* Resource accounting. Each session keeps its own count of main loop
+ * time and dispatches (handlers, realize, tree area updates) and of
+ * session file and journal bytes, see LCIUsage. Widgets and heap are
+ * counted when asked for: its window's widget tree, and what its
+ * tree model, project index and document hold, a document shared
+ * being split between its sessions. gtk's own allocations behind a
+ * widget are not seen, widget count stands for them. Shown:
+ *   <control><shift><i>         stats window, refreshed each second
+ *   kill -USR1 `pidof windows`  table on stdout, with handler stats
+ * With LCI_STATS=<file> in environment, SIGUSR1 also writes the
+ * table as JSON there. The control socket's 'stats' answers it too.
+ */
+#define USAGE_REFRESH_SECONDS 1
+
+static const char *usage_file;
+static GtkWidget *usage_window;
+static GtkTextBuffer *usage_text;
+static guint usage_source;
+
+static void
+usage_count_widget(GtkWidget *widget, gpointer data) {
+
+  (*(guint *)data)++;
+  if (GTK_IS_CONTAINER(widget))
+    gtk_container_forall(GTK_CONTAINER(widget), usage_count_widget, data);
+}
+
+static guint
+usage_widgets(LCISession *session) {
+
+  guint count = 0;
+  usage_count_widget(session->main_window, &count);
+  return count;
 }
 
-/* Support for lci_session_close(), this accesses clock
- * to determine a 'quit' signal event. Gala WM sends
- * multiple 'destroy' singles for each window.
- * To save multiple sessions, need to append open file write
- * versus a single session write.
+/* Heap held for 'session', its document's mapped bytes into 'mapped'.
+ * Its strings are interned, shared with snapshots, documents and
+ * other sessions, so are counted once for all, see usage_json().
  */
-static char *
-session_save_mode(char **mode) {
-
-  static struct timespec last_tp = {0,0};
-  struct timespec tp;
-  clock_gettime(CLOCK_MONOTONIC, &tp);
-
-  int append = 0;
-  if ((last_tp.tv_nsec != 0) && (last_tp.tv_sec != 0)) {
-    if ((tp.tv_nsec - last_tp.tv_nsec) < 0) {
-      if ( ((tp.tv_sec - last_tp.tv_sec - 1) == 0) &&
-           ((tp.tv_nsec - last_tp.tv_nsec + 1000000000) < 250000000) ) {
-        append = 1;
-      }
-    } else {
-      if ( ((tp.tv_sec - last_tp.tv_sec) == 0) &&
-           ((tp.tv_nsec - last_tp.tv_nsec) < 250000000) ) {
-        append = 1;
-      }
-    }
+static gsize
+usage_heap(LCISession *session, gsize *mapped) {
+
+  gsize heap = sizeof(LCISession);
+  if (session->tree_model != NULL)
+    heap += lci_tree_model_bytes(session->tree_model);
+  if (session->project_index != NULL)
+    heap += project_index_bytes(session->project_index);
+  *mapped = 0;
+  if (session->document != NULL) {
+    LCIDocument *document = session->document;
+    size_t original;
+    heap += text_buffer_bytes(document->text, &original) / document->refs;
+    *mapped = original / document->refs;
   }
-  last_tp.tv_sec = tp.tv_sec;
-  last_tp.tv_nsec = tp.tv_nsec;
-  return *mode = (append ? "a" : "w");
+  return heap;
 }
 
-/* Opens master file, writes window displayed sequence,
- * and allows session_save() to save session's data to file.
- * Removes window, adjusts ordering of remaining windows, and
- * frees resources of closing session.
- *   Wm closes by 'delete' in 'order of creation' (LIFO).
- * For consistancy, 'quit' does the same.
- */
-gboolean
-lci_session_close(GtkWidget *widget, GdkEvent *event, LCISession *session) {
+static const char *
+usage_state(LCISession *session) {
 
-  char *mode;
-  FILE *wh = fopen(master_file, session_save_mode(&mode));
-quit_event:
-  if (wh == NULL) {
-    puts("ERROR: unable to save session");
-  } else {
-    // will save 'session' file's current state
-    // response can signal user canceled due to unsaved changes
-    int response = session_save(wh, session, mode);
-    fclose(wh);
-    if (response == GTK_RESPONSE_CANCEL)
-      return TRUE;
+  if (session->hibernated)  return "hibernated";
+  return session->realized ? "realized" : "bare";
+}
+
+  // one line, foreground first
+static void
+usage_json(FILE *fh) {
+
+  fprintf(fh, "{\"sessions\":[");
+  for (LCISession *session = session_top; session != NULL;
+                                          session = session->below) {
+    gsize mapped;
+    gsize heap = usage_heap(session, &mapped);
+    const char *title = session->title;
+    fprintf(fh, "%s{\"session\":", (session == session_top) ? "" : ",");
+    trace_json_string(fh, session->session_file);
+    fprintf(fh, ",\"title\":");
+    trace_json_string(fh, (title != NULL) ? title : "");
+    fprintf(fh, ",\"project\":%s,\"state\":\"%s\",\"widgets\":%u"
+                ",\"heap\":%" G_GSIZE_FORMAT ",\"mapped\":%" G_GSIZE_FORMAT
+                ",\"read\":%" G_GUINT64_FORMAT ",\"written\":%" G_GUINT64_FORMAT
+                ",\"dispatches\":%" G_GUINT64_FORMAT ",\"main_us\":%" G_GINT64_FORMAT "}",
+                (session->project_index != NULL) ? "true" : "false",
+                usage_state(session), usage_widgets(session), heap, mapped,
+                session->usage.read, session->usage.written,
+                session->usage.dispatches, session->usage.main_us);
   }
+  fprintf(fh, "],\"documents\":%u,\"interned\":%zu}",
+              (documents != NULL) ? g_hash_table_size(documents) : 0,
+              intern_bytes());
+}
 
-  if (nsessions > 1) {
-      // remove session->sslot
-    int idx = session->sslot;
-    int order = session->order;
-    if (session->sslot != (nsessions - 1)) {
-      do {
-        session_stack[idx] = session_stack[(idx + 1)];
-        session_stack[idx]->sslot = idx;
-      } while ((++idx) < (nsessions - 1));
-    }
-    session_stack[idx] = NULL;
-    nsessions--;
-    gtk_widget_destroy(session->main_window);
-    free(session->session_file);
-    free(session);
-    for (int idx = 0;
-          ((idx < LCISESSION_LIMIT) && (session_stack[idx] != NULL)); idx++)
-      if (session_stack[idx]->order > order)  session_stack[idx]->order--;
+static void
+usage_table(GString *table) {
 
-    if (event->type == GDK_QUIT) {
-      mode = "a";
-      wh = fopen(master_file, mode);
-      session = session_stack[(nsessions - 1)];
-      goto quit_event;
-    }
+  g_string_append_printf(table, "%-24s %-10s %7s %9s %9s %9s %9s %10s %10s\n",
+                         "session", "state", "widgets", "heap KB", "mapped KB",
+                         "read", "written", "dispatches", "main ms");
+  for (LCISession *session = session_top; session != NULL;
+                                          session = session->below) {
+    gsize mapped;
+    gsize heap = usage_heap(session, &mapped);
+    const char *title = session->title;
+    g_string_append_printf(table, "%-24.24s %-10s %7u %9" G_GSIZE_FORMAT
+                           " %9" G_GSIZE_FORMAT " %9" G_GUINT64_FORMAT
+                           " %9" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT
+                           " %10" G_GINT64_FORMAT "\n",
+                           (title != NULL) ? title : session->session_file,
+                           usage_state(session), usage_widgets(session),
+                           (heap / 1024), (mapped / 1024),
+                           session->usage.read, session->usage.written,
+                           session->usage.dispatches,
+                           (session->usage.main_us / 1000));
+  }
+  g_string_append_printf(table, "%u documents, %zu KB interned strings\n",
+                         (documents != NULL) ? g_hash_table_size(documents) : 0,
+                         (intern_bytes() / 1024));
+}
+
+static gboolean
+usage_dump(gpointer data) {
 
-    return FALSE;
+    // SIGUSR1's one handler, handler statistics first
+  handler_dump(data);
+  GString *table = g_string_new(NULL);
+  usage_table(table);
+  fputs(table->str, stdout);
+  fflush(stdout);
+  g_string_free(table, TRUE);
+  if (usage_file == NULL)  return G_SOURCE_CONTINUE;
+  FILE *fh = fopen(usage_file, "w");
+  if (fh == NULL) {
+    puts("ERROR: unable to write stats");
+    return G_SOURCE_CONTINUE;
   }
-    // make nsessions 0, gtk_main_quit() does return
-  nsessions--;
-  gtk_widget_destroy(session->main_window);
-  free(session->session_file);
-  free(session);
-  gtk_main_quit();
-  return FALSE;
+  usage_json(fh);
+  fputc('\n', fh);
+  fclose(fh);
+  return G_SOURCE_CONTINUE;
 }
 
-/* gdk, and window managers lack support for multi-window apps */
-void
-lci_session_quit(LCISession *top_session) {
+static gboolean
+usage_refresh(gpointer data) {
 
-  (void)top_session;
+  (void)data;
+  GString *table = g_string_new(NULL);
+  usage_table(table);
+  gtk_text_buffer_set_text(usage_text, table->str, table->len);
+  g_string_free(table, TRUE);
+  return G_SOURCE_CONTINUE;
+}
 
-  GdkEvent *event = gdk_event_new(GDK_DELETE);
-  event->type = GDK_QUIT;
-  lci_session_close(NULL, event, session_stack[(nsessions - 1)]);
-    // reaches here on a cancel of save by user in 'close'
-  gdk_event_free(event);
+static void
+usage_destroyed(GtkWidget *widget, gpointer data) {
+
+  (void)widget, (void)data;
+  g_source_remove(usage_source);
+  usage_source = 0;
+  usage_window = NULL;
+  usage_text = NULL;
 }
 
-/* Assign a name to new editor session */
-static char *
-session_name(void) {
+  // stats window, closed again when already shown
+static void
+usage_view(void) {
 
-  if ((++total_created_sessions) == 1)
-    return name_of_session;
-  sprintf(&name_of_session[NOS_APPEND],
-               " - Session %d", total_created_sessions);
-  return name_of_session;
+  if (usage_window != NULL) {
+    gtk_widget_destroy(usage_window);
+    return;
+  }
+  usage_window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+  gtk_window_set_title(GTK_WINDOW(usage_window), "Sessions - Resources");
+  gtk_window_set_default_size(GTK_WINDOW(usage_window), 900, 300);
+  GtkWidget *scrolled = gtk_scrolled_window_new(NULL, NULL);
+  GtkWidget *view = gtk_text_view_new();
+  gtk_text_view_set_editable(GTK_TEXT_VIEW(view), FALSE);
+  gtk_text_view_set_monospace(GTK_TEXT_VIEW(view), TRUE);
+  usage_text = gtk_text_view_get_buffer(GTK_TEXT_VIEW(view));
+  gtk_container_add(GTK_CONTAINER(scrolled), view);
+  gtk_container_add(GTK_CONTAINER(usage_window), scrolled);
+  g_signal_connect(G_OBJECT(usage_window), "destroy",
+                                  G_CALLBACK(usage_destroyed), NULL);
+  usage_refresh(NULL);
+  usage_source = g_timeout_add_seconds(USAGE_REFRESH_SECONDS,
+                                       usage_refresh, NULL);
+  gtk_widget_show_all(usage_window);
+}
+
+static void
+usage_init(void) {
+
+  usage_file = g_getenv("LCI_STATS");
+  if ((usage_file != NULL) && (*usage_file == 0))
+    usage_file = NULL;
+  g_unix_signal_add(SIGUSR1, usage_dump, NULL);
 }
 
-/* Connects new or previous session data to a draw port */
+  // a session's window and its handlers, without title or geometry
 static void
-session_connect(LCISession *session, char *session_name) {
+session_window(LCISession *session) {
 
   GtkWidget *main_window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
   session->main_window = main_window;
-  gtk_window_set_title(GTK_WINDOW(main_window), session_name);
-  gtk_window_set_default_size(GTK_WINDOW(main_window),
-                                      session->sz_x, session->sz_y);
-  gtk_window_move(GTK_WINDOW(main_window), session->pt_x, session->pt_y);
   g_signal_connect(G_OBJECT(main_window), "delete-event",
-                                  G_CALLBACK(lci_session_close), session);
+                                  G_CALLBACK(handler_close), session);
       // monitor user preference of size/position
   gtk_widget_add_events(main_window, GDK_STRUCTURE_MASK);
   g_signal_connect(G_OBJECT(main_window), "configure-event",
-                                  G_CALLBACK(session_update), session);
+                                  G_CALLBACK(handler_update), session);
     // will catch focus, but multiple signals (does a dance, gtk)
   g_signal_connect(G_OBJECT(main_window), "window-state-event",
-                                  G_CALLBACK(session_update), session);
+                                  G_CALLBACK(handler_update), session);
     // multiple windows (sessions)
   g_signal_connect(G_OBJECT(main_window), "key-press-event",
-                                  G_CALLBACK(session_keypress), session);
+                                  G_CALLBACK(handler_keypress), session);
   gtk_widget_add_events(main_window, GDK_FOCUS_CHANGE_MASK);
   g_signal_connect_after(G_OBJECT(main_window), "focus-in-event",
-                                  G_CALLBACK(session_reorder), session);
+                                  G_CALLBACK(handler_reorder), session);
+}
+
+/* Connects new or previous session data to a draw port. A session
+ * taken from the window pool already has one.
+ */
+static void
+session_connect(LCISession *session, const char *session_name) {
+
+  gint64 start = trace_now();
+  if (session->main_window == NULL) {
+    session_window(session);
+    gtk_window_set_default_size(GTK_WINDOW(session->main_window),
+                                        session->sz_x, session->sz_y);
+  } else {
+      // was on screen before, default size no longer applies
+    gtk_window_resize(GTK_WINDOW(session->main_window),
+                                        session->sz_x, session->sz_y);
+  }
+  const char *title = intern_string(session_name);
+  intern_release(session->title);
+  session->title = title;
+  gtk_window_set_title(GTK_WINDOW(session->main_window), title);
+  gtk_window_move(GTK_WINDOW(session->main_window),
+                                        session->pt_x, session->pt_y);
 
   /*
    * This is point where you add routine to attach your
    * user interfaces to create your application. Boxes, menus,
    * different views, are attached to GTK_CONTAINER(session->main_window).
+   * See session_realize(), restore defers it for background sessions.
    */
-  session_interface_create(session);
    /* Up to you the structures you add to maintain widgets, as is
    * keeping 'session_stack' static, global or allocation of its
    * memory usage. Could even add session_stack location to
    * struct _LciSession to pass to routines.
    */
+  trace_span("session_connect", start, session->session_file);
+}
+
+/* Window pool. Building a window, connecting its handlers and its
+ * interface is most of what a new session costs. Shells, an unmapped
+ * window with interface built, are kept in 'session_pool': filled up
+ * to POOL_WARM from a low priority idle, and closed windows are reset
+ * and put back, up to POOL_LIMIT, rather than destroyed. A shell is
+ * an LCISession whose 'session_file' is NULL, its handlers already
+ * point at it.
+ */
+#define POOL_WARM   2
+#define POOL_LIMIT  4
+static LCISession *session_pool[POOL_LIMIT];
+static int npooled;
+static guint session_pool_source;
+
+static gboolean
+session_pool_fill(gpointer data) {
+
+  (void)data;
+  if (npooled >= POOL_WARM) {
+    session_pool_source = 0;
+    return G_SOURCE_REMOVE;
+  }
+    // one shell per idle, input stays first
+  gint64 start = trace_now();
+  LCISession *session = session_alloc();
+  session_window(session);
+  session_interface_create(session);
+  session->realized = 1;
+  session_pool[npooled++] = session;
+  trace_span("session_pool_fill", start, NULL);
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+session_pool_warm(void) {
+
+  if ((session_pool_source == 0) && (npooled < POOL_WARM))
+    session_pool_source = g_idle_add_full(G_PRIORITY_LOW,
+                                   session_pool_fill, NULL, NULL);
+}
+
+  // a shell if one is ready, else a blank session
+static LCISession *
+session_pool_take(void) {
+
+  if (npooled == 0)
+    return session_alloc();
+  LCISession *session = session_pool[(--npooled)];
+  session_pool_warm();
+  return session;
+}
+
+/* Keeps a closed session's window as a shell. 'session' has been
+ * unregistered and its strings freed. Return 0 when pool is full,
+ * caller then destroys it.
+ */
+static int
+session_pool_put(LCISession *session) {
+
+  if ((npooled >= POOL_LIMIT) || (!session->realized))
+    return 0;
+  GtkWidget *main_window = session->main_window;
+  GtkWidget *paned = session->paned;
+  GtkWidget *tree_view = session->tree_view;
+  GtkWidget *editor_box = session->editor_box;
+  LCITreeModel *tree_model = session->tree_model;
+  gtk_widget_hide(main_window);
+  if (session->maximized)
+    gtk_window_unmaximize(GTK_WINDOW(main_window));
+    // interface addition, return views to empty
+//  lci_textport_reset(session);
+//  lci_treeport_reset(session);
+  memset(session, 0, sizeof(LCISession));
+  session->main_window = main_window;
+  session->paned = paned;
+  session->tree_view = tree_view;
+  session->editor_box = editor_box;
+  session->tree_model = tree_model;
+  session->realized = 1;
+  session_pool[npooled++] = session;
+  return 1;
+}
+
+static void
+session_decode_worker(gpointer data, gpointer user_data) {
+
+  (void)user_data;
+  gint64 start = trace_now();
+  textport_unflatten(data);
+  trace_span("session_decode", start, ((LCIRestore *)data)->path);
+}
+
+/* Connects session to a draw port from a decoded 'entry', journal
+ * changes over session file's data.
+ * Return 1 when there was no session data.
+ */
+static int
+session_load(LCISession *session, const LCIRestore *entry) {
+
+  const int32_t *geometry;
+  const char *title;
+
+  if (entry->stored) {
+    title = entry->stored_title;
+    geometry = entry->has_geometry ? entry->geometry : entry->stored_geometry;
+  } else if ((entry->title != NULL) && entry->has_geometry) {
+      // never saved, journal alone knows of it
+    title = entry->title;
+    geometry = entry->geometry;
+  } else {
+    return 1;
+  }
+  session->maximized = 0;
+  session->pt_x = geometry[0], session->pt_y = geometry[1];
+  session->sz_x = geometry[2], session->sz_y = geometry[3];
+  session->usage.read += entry->stored_size;
+  session_connect(session, title);
+  return 0;
 }
 
 /* Attempt to create session without flicker */
@@ -437,36 +2650,37 @@ session_connect(LCISession *session, char *session_name) {
 LCISession *
 lci_session_open(char *named_session) {
 
-  LCISession *session = malloc(sizeof(LCISession));
-  session_stack[nsessions] = session;
-  session_stack[nsessions]->sslot = nsessions;
-  session_stack[nsessions]->order = 0;
-  if (nsessions > 0) {
-    int odx = nsessions;
-    do session_stack[(--odx)]->order++; while (odx > 0);
-  }
+  gint64 start = trace_now();
+  LCISession *session = session_pool_take();
   session->project_name = NULL;
-  session->session_file = strdup(named_session);
+  session->closing = 0;
+  session->session_file = intern_string(named_session);
     /* extract data from file, position/name */
-  char title[128];
-  FILE *sh = fopen(session->session_file, "r");
-  fscanf(sh, "%d %d %d %d "
-//             "%d "
-             "\"%[^\"]\"\n",
-             &session->pt_x, &session->pt_y,
-             &session->sz_x, &session->sz_y,
-//             &session->pd_x,
-             title);
-  session_connect(session, title);
-    // get rest of session data
-//  lci_textport_unflatten(sh, session);
-//  lci_treeport_unflatten(sh, session);
-  fclose(sh);
+  LCIRestore entry = { (char *)session->session_file };
+  textport_unflatten(&entry);
+  int failed = session_load(session, &entry);
+  free(entry.stored_title);
+  if (failed) {
+      // gone, or not a session, nothing to offer as recent
+    session_recent_note(named_session, NULL, NULL, 0);
+    textport_restore_free(entry.text);
+    intern_release(session->session_file);
+    session->session_file = NULL;
+    if ((session->main_window == NULL) || (!session_pool_put(session)))
+      session_dispose(session);
+    return NULL;
+  }
+  session->project_name = session_project_name(session->session_file);
+  textport_attach(session, entry.text);
+  session_register(session);
+  session_realize(session);
+  session_index_open(session);
+  journal_note(JOURNAL_OPEN, session);
     // sequence present,show for focus on window
   gtk_window_present(GTK_WINDOW(session->main_window));
   gtk_widget_show_all(session->main_window);
-  nsessions++;
   total_created_sessions++;
+  trace_span("lci_session_open", start, session->session_file);
   return session;
 }
 
@@ -492,8 +2706,8 @@ session_position(LCISession *session) {
       // interface addition
 //    session->pd_x = session->sz_x / 5;
   } else {
-      // offset window based on last window created
-    LCISession *base = session_stack[(nsessions - 1)];
+      // offset window based on foreground window
+    LCISession *base = session_top;
     session->pt_x = base->pt_x + OS_HEADER_MARGIN;
     session->pt_y = base->pt_y + OS_HEADER_MARGIN;
     if (((session->sz_x + session->pt_x) > workarea.width) ||
@@ -514,141 +2728,635 @@ session_position(LCISession *session) {
 LCISession *
 lci_session_create(char *named_session) {
 
-  LCISession *session = malloc(sizeof(LCISession));
-  session_stack[nsessions] = session;
-  session_stack[nsessions]->sslot = nsessions;
-  session_stack[nsessions]->order = 0;
-  if (nsessions > 0) {
-    int odx = nsessions;
-    do session_stack[(--odx)]->order++; while (odx > 0);
-  }
+  gint64 start = trace_now();
+  LCISession *session = session_pool_take();
+  session->closing = 0;
 
+  char *session_file;
+  const char *title;
   if (named_session == NULL) {
       // based off user's home directory, create session's area
+      // master_file is left alone, persistence worker reads it
     session->project_name = NULL;
-    char *appendptr = strrchr(master_file, '/') + 1;
-    named_session = session_name();
-    sprintf(appendptr, "%s/session.lproj", named_session);
-    session->session_file = strdup(master_file);
-    strcpy(appendptr, "session.lproj");
+    title = session_name();
+    int dir_len = (strrchr(master_file, '/') + 1) - master_file;
+    session_file = g_strdup_printf("%.*s%s/session.lproj",
+                                   dir_len, master_file, title);
   } else {
-      // deal with new project
-    char hold[1024];
-    session->project_name = strdup(strrchr(named_session, '/') + 1);
-    mkdir(named_session, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
-    strcpy(hold, named_session);
-    strcat(hold, "/session.lproj");
-    session->session_file = strdup(hold);
-    named_session = session->project_name;
+      // deal with new project, a bare name being in current directory
+      // kept absolute, never taken for an editor session of master's
+    char *directory = g_canonicalize_filename(named_session, NULL);
+    session->project_name = intern_string(strrchr(directory, '/') + 1);
+    mkdir(directory, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+    session_file = g_strconcat(directory, "/session.lproj", NULL);
+    g_free(directory);
+    title = session->project_name;
   }
+  session->session_file = intern_string(session_file);
+  g_free(session_file);
   session_position(session);
-  session_connect(session, named_session);
-  nsessions++;
+  session_connect(session, title);
+  session_register(session);
+  session_realize(session);
+  session_index_open(session);
+  journal_note(JOURNAL_OPEN, session);
   gtk_widget_show_all(session->main_window);
   gtk_window_present(GTK_WINDOW(session->main_window));
+  trace_span("lci_session_create", start, session->session_file);
   return session;
 }
 
+/* Session files are decoded by up to RESTORE_THREADS workers, they
+ * mostly wait on file systems rather than use a cpu.
+ */
+#define RESTORE_THREADS 16
+
 /* Loads last session(s) based on, and way, you
  * saved data on application 'quit'.
- * Load previous user state, based on 'master' file.
+ * Load previous user state, based on 'master' file, with
+ * journal replayed over it.
  */
 static int
-session_restore(FILE *rh) {
+session_restore(char *master) {
 
-  int  order[LCISESSION_LIMIT];
-  char scan_line[1024];
-  char *paths[LCISESSION_LIMIT];
-  int session_count;
+  LCIRestoreList list = { NULL, 0, 0 };
+  store_read_master(master, &list);
 
-  if (fscanf(rh, "#%d", &session_count) == EOF)
-    return 1;
-  for (int idx = 0; idx < session_count; idx++)
-    fscanf(rh, "%d", &order[idx]);
-  fscanf(rh, "%c", &scan_line[0]);
+  gint64 start = trace_now();
+  int replayed = journal_replay(&list, journal_old)
+                 + journal_replay(&list, journal_file);
+  trace_span("journal_replay", start, NULL);
 
-  for (int idx = 0; idx < session_count; idx++) {
-    if (fscanf(rh, "\"%[^\"]\"\n", scan_line) == EOF)
-      break;
-    paths[idx] = strdup(scan_line);
-  }
-
-  for (int idx = 0; idx < session_count; idx++) {
-      // find bottom, out first
-    int odx = 0;
-            // i1 2 1 == 1
-    while (order[odx] != ((session_count - 1) - idx)) odx++;
-    LCISession *session = malloc(sizeof(LCISession));
-    session_stack[idx] = session;
-    session->sslot = idx;
-    session->order = order[odx];
+    // all session files read at once, slowest sets the pace
+    // project directories may be on slow or remote mounts
+  if (list.count > 1) {
+    GThreadPool *pool = g_thread_pool_new(session_decode_worker, NULL,
+                                          MIN(list.count, RESTORE_THREADS),
+                                          TRUE, NULL);
+    for (int pos = 0; pos < list.count; pos++)
+      g_thread_pool_push(pool, &list.entries[pos], NULL);
+    g_thread_pool_free(pool, FALSE, TRUE);
+  } else if (list.count == 1) {
+    session_decode_worker(&list.entries[0], NULL);
+  }
+
+    // documents of all first, shared ones then find theirs
+  for (int pos = 0; pos < list.count; pos++)
+    textport_register(list.entries[pos].text, list.entries[pos].path);
+
+    // bottom out first, each new one then is foreground
+  for (int pos = (list.count - 1); pos >= 0; pos--) {
+    LCIRestore *entry = &list.entries[pos];
+    LCISession *session = session_alloc();
     session->project_name = NULL;
+    session->closing = 0;
+    session->session_file = intern_string(entry->path);
+    free(entry->path);
+    if (session_load(session, entry)) {
+      textport_restore_free(entry->text);
+      intern_release(session->session_file);
+      session_dispose(session);
+    } else {
+      session->project_name = session_project_name(session->session_file);
+      textport_attach(session, entry->text);
+      session_register(session);
+      total_created_sessions++;
+    }
+    free(entry->title);
+    free(entry->stored_title);
+  }
+  free(list.entries);
 
-    session->session_file = paths[odx];
-    char title[128];
-    FILE *sh = fopen(session->session_file, "r");
-    fscanf(sh, "%d %d %d %d "
-//               "%d "
-               "\"%[^\"]\"\n",
-               &session->pt_x, &session->pt_y,
-               &session->sz_x, &session->sz_y,
-//               &session->pd_x,
-               title);
-    session_connect(session, title);
-      // get rest of session data
-//    lci_textport_unflatten(sh, session);
-//    lci_treeport_unflatten(sh, session);
-    fclose(sh);
-    gtk_widget_show_all(session->main_window);
-    nsessions++;
-    total_created_sessions++;
+    // foreground's interface first, others stay bare windows for now
+    // mapping bottom up leaves foreground on top
+  if (session_top != NULL) {
+    session_realize(session_top);
+    for (LCISession *session = session_bottom; session != NULL;
+                                               session = session->above)
+      gtk_widget_show_all(session->main_window);
+    gtk_window_present(GTK_WINDOW(session_top->main_window));
+    if (session_top != session_bottom)
+      session_realize_later();
   }
-  return 0;
+    // fold replayed changes into snapshot, once up
+  if (replayed != 0)
+    g_idle_add(journal_compact_idle, NULL);
+  return (nsessions == 0);
 }
 
-static void
-session_master(char *master) {
+  // start up ends with foreground's first frame drawn
+static gboolean
+trace_first_frame(GtkWidget *widget, cairo_t *cr, gpointer data) {
+
+  trace_instant("first_frame", NULL);
+  trace_span("startup", trace_origin, NULL);
+  g_signal_handlers_disconnect_by_func(widget, trace_first_frame, data);
+  return FALSE;
+}
+
+static char *
+session_master(void) {
 
 //  char *homedir;
 //  uid_t uid = getuid();
 //  struct passwd *pw = getpwuid(uid);
 //  homedir = (pw != NULL) ? pw->pw_dir : getenv("HOME");
 //  if (homedir != NULL) {
-//    strcpy(master, homedir);
-//    strcat(master, "/.lcode/");
+//    char *master = g_strconcat(homedir, "/.lcode/", NULL);
 //    mkdir(master, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+//    g_free(master);
+//    return g_strconcat(homedir, "/.lcode/session.lproj", NULL);
 //  }
-  strcat(master, "session.lproj");
+  return g_strdup("./session.lproj");
 }
 
-int
-main(int argc, char *argv[]) {
-
-    // initialize session tracking
-  nsessions = LCISESSION_LIMIT;
-  do session_stack[(--nsessions)] = NULL; while (nsessions != 0);
+static void control_init(void);
 
-    // initialize gtk
-  gtk_init(&argc, &argv);
+  // gtk is up, bring back user's sessions
+static void
+session_start(void) {
 
     // there is only one session 'master'
     // it belongs to the 'user'
-  session_master(master_file);
+  gint64 phase = trace_now();
+  handler_init();
+  usage_init();
+  master_file = session_master();
+  journal_init();
+  hibernate_init();
+  recent_load_start();
+  control_init();
+  trace_span("session_master", phase, NULL);
 
     // start up a new or existing session
-  FILE *rh = fopen(master_file, "r");
-  if (rh != NULL) {
-      // possible error of blank data
-    if (session_restore(rh))
-      lci_session_create(NULL);
-    fclose(rh);
+    // possible error of blank data
+  phase = trace_now();
+  if (session_restore(master_file))
+    lci_session_create(NULL);
+  trace_span("session_restore", phase, NULL);
+  session_pool_warm();
+  if (trace_file != NULL)
+    g_signal_connect_after(G_OBJECT(session_top->main_window), "draw",
+                           G_CALLBACK(trace_first_frame), NULL);
+}
+
+  // restored and created sessions may hold paths relative to cwd
+static int
+session_file_is(LCISession *session, const char *canonical) {
+
+  char *path = g_canonicalize_filename(session->session_file, NULL);
+  int same = (strcmp(path, canonical) == 0);
+  g_free(path);
+  return same;
+}
+
+  // raised if open, else reopened, NULL if not saved before
+static LCISession *
+session_open_file(const char *session_file) {
+
+  char *canonical = g_canonicalize_filename(session_file, NULL);
+  LCISession *session = session_top;
+  while ((session != NULL) && (!session_file_is(session, canonical)))
+    session = session->below;
+  g_free(canonical);
+  if (session != NULL) {
+    session_realize(session);
+    gtk_window_present(GTK_WINDOW(session->main_window));
+  } else if (access(session_file, R_OK) == 0) {
+    session = lci_session_open((char *)session_file);
+  }
+  return session;
+}
+
+/* A project directory given on command line. Raised if already
+ * open, reopened if saved before, else created. 'path' is absolute.
+ */
+static LCISession *
+session_open_path(const char *path) {
+
+  char *session_file = g_strconcat(path, "/session.lproj", NULL);
+  LCISession *session = session_open_file(session_file);
+  g_free(session_file);
+  if (session == NULL)
+    session = lci_session_create((char *)path);
+  return session;
+}
+
+/* Control socket. With LCI_CONTROL=<path> in environment, a unix
+ * domain socket there, owner only, takes batches of commands, one
+ * per line, a batch ending with an empty line:
+ *   create [project-dir]       new editor session, or project
+ *   open project-dir           raised, reopened or created
+ *   recent query               recent catalog's best match, as open
+ *   edit [file]                into foreground session, or a new one
+ *   close target               closes, all of them is a quit
+ *   move x y width height target
+ *   raise target
+ *   save                       every session and master
+ *   stats                      resource usage, as JSON, see usage_json()
+ * A project-dir is taken from process's current directory when
+ * relative, and must name one, not be root.
+ * 'target' is a session file, as replies name them, or 'top'. A
+ * batch is run whole from one main loop dispatch, closes together
+ * at its end, then replied to line for line:
+ *   ok|error µs [session file|reason]
+ * and 'done count µs' with an empty line. Anything but a socket
+ * already at <path> is left alone, there is then no control socket.
+ */
+#define CONTROL_INPUT_MAX  (256 * 1024)   // unended batch, client is dropped
+
+typedef struct _LciControlClient {
+  int          fd;
+  guint        source;
+  GString     *input;
+} LCIControlClient;
+
+static char *control_path;
+static int control_fd = -1;
+
+static LCISession *
+control_target(const char *target) {
+
+  int top = (strcmp(target, "top") == 0);
+  for (LCISession *session = session_top; session != NULL;
+                                          session = session->below)
+    if ( (!session->closing)
+        && (top || (strcmp(session->session_file, target) == 0)) )
+      return session;
+  return NULL;
+}
+
+  // project directory argument made absolute, NULL with reason if unusable
+static char *
+control_project(const char *arg, GString *detail) {
+
+  if ((arg == NULL) || (*arg == 0)) {
+    g_string_assign(detail, "needs a project directory");
+    return NULL;
+  }
+  char *path = g_canonicalize_filename(arg, NULL);
+    // absolute, so always a '/', only root has nothing after
+  if (strrchr(path, '/')[1] == 0) {
+    g_string_assign(detail, "project directory has no name");
+    g_free(path);
+    return NULL;
+  }
+  return path;
+}
+
+  // one command, reply's reason or session file into 'detail'
+static int
+control_command(char *line, GString *detail, int *closes) {
+
+  char *arg = strchr(line, ' ');
+  if (arg != NULL)  *arg++ = 0;
+  LCISession *session = NULL;
+
+  if ( session_quitting
+      && ( (strcmp(line, "create") == 0) || (strcmp(line, "open") == 0)
+          || (strcmp(line, "recent") == 0) ) ) {
+    g_string_assign(detail, "quitting");
+    return 1;
+  } else if ((strcmp(line, "create") == 0) && (arg == NULL)) {
+    session = lci_session_create(NULL);
+  } else if ( (strcmp(line, "create") == 0) || (strcmp(line, "open") == 0) ) {
+    char *path = control_project(arg, detail);
+    if (path == NULL)  return 1;
+    session = (line[0] == 'c') ? lci_session_create(path)
+                               : session_open_path(path);
+    g_free(path);
+  } else if (strcmp(line, "recent") == 0) {
+    LCIRecentEntry *found;
+    if ((arg == NULL) || (lci_recent_find(arg, &found, 1) == 0)) {
+      g_string_assign(detail, "no recent session matches");
+      return 1;
+    }
+    if ((session = session_open_file(found->path)) == NULL) {
+      g_string_assign(detail, "recent session is gone");
+      return 1;
+    }
+  } else if (strcmp(line, "edit") == 0) {
+    if ((session = control_target("top")) == NULL) {
+      g_string_assign(detail, "no session");
+      return 1;
+    }
+    char *path = (arg == NULL) ? NULL : g_canonicalize_filename(arg, NULL);
+    int response = lci_textport_open(session, path);
+    g_free(path);
+    if (response == GTK_RESPONSE_CANCEL) {
+      g_string_assign(detail, "unable to open file");
+      return 1;
+    }
+  } else if (strcmp(line, "save") == 0) {
+    journal_compact_start();
+    return 0;
+  } else if (strcmp(line, "stats") == 0) {
+    char *json;
+    size_t length;
+    FILE *fh = open_memstream(&json, &length);
+    usage_json(fh);
+    fclose(fh);
+    g_string_assign(detail, json);
+    free(json);
+    return 0;
+  } else if (strcmp(line, "move") == 0) {
+    int x, y, width, height, used = 0;
+    if ( (arg == NULL)
+        || (sscanf(arg, "%d %d %d %d %n", &x, &y, &width, &height, &used) < 4)
+        || ((session = control_target(arg + used)) == NULL) ) {
+      g_string_assign(detail, "move needs x y width height and a session");
+      return 1;
+    }
+    GtkWindow *window = GTK_WINDOW(session->main_window);
+    if (session->maximized)
+      gtk_window_unmaximize(window);
+    gtk_window_move(window, x, y);
+    gtk_window_resize(window, width, height);
+    session->maximized = 0;
+    session->pt_x = x, session->pt_y = y;
+    session->sz_x = width, session->sz_y = height;
+    session_changed(session, SESSION_GEOMETRY);
+  } else if ( (strcmp(line, "raise") == 0) || (strcmp(line, "close") == 0) ) {
+    if ((arg == NULL) || ((session = control_target(arg)) == NULL)) {
+      g_string_assign(detail, "no such session");
+      return 1;
+    }
+    if (line[0] == 'c') {
+      session->closing = 1;
+      gtk_widget_hide(session->main_window);
+      (*closes)++;
+    } else {
+      session_realize(session);
+      gtk_window_present(GTK_WINDOW(session->main_window));
+      session_focus(session);
+    }
   } else {
+    g_string_assign(detail, "unknown command");
+    return 1;
+  }
+  if (session != NULL)
+    g_string_assign(detail, session->session_file);
+  return (session == NULL);
+}
+
+static void
+control_batch(LCIControlClient *client, char *batch) {
+
+  gint64 traced = trace_now();
+  gint64 start = g_get_monotonic_time();
+  GString *reply = g_string_new(NULL);
+  GString *detail = g_string_new(NULL);
+  int count = 0, closes = 0;
+  session_flush_now();
+  for (char *line = batch, *next; *line != 0; line = next) {
+    next = strchr(line, '\n');
+    *next++ = 0;
+    if (*line == 0)  continue;
+    gint64 begun = g_get_monotonic_time();
+    g_string_truncate(detail, 0);
+    int failed = control_command(line, detail, &closes);
+    if (failed && (detail->len == 0))
+      g_string_assign(detail, "session not made");
+    g_string_append_printf(reply, "%s %" G_GINT64_FORMAT " %s\n",
+                           (failed ? "error" : "ok"),
+                           (g_get_monotonic_time() - begun), detail->str);
+    count++;
+  }
+    // as a window manager's burst of closes would
+  if (closes != 0) {
+    if (close_burst != 0) {
+      g_source_remove(close_burst);
+      close_burst = 0;
+    }
+    session_close_burst(NULL);
+  }
+  gint64 total = g_get_monotonic_time() - start;
+  g_string_append_printf(reply, "done %d %" G_GINT64_FORMAT "\n\n",
+                                count, total);
+  trace_span("control_batch", traced, NULL);
+  if (send(client->fd, reply->str, reply->len, MSG_NOSIGNAL)
+                                              != (ssize_t)reply->len)
+    shutdown(client->fd, SHUT_RDWR);
+  g_string_free(detail, TRUE);
+  g_string_free(reply, TRUE);
+}
+
+static gboolean
+control_read(gint fd, GIOCondition condition, gpointer data) {
+
+  (void)condition;
+  LCIControlClient *client = data;
+  char block[4096];
+  ssize_t got;
+  int error = 0;
+    // a client that never stops writing is not to hold main loop here
+  while ((got = read(fd, block, sizeof(block))) > 0) {
+    g_string_append_len(client->input, block, got);
+    if (client->input->len > CONTROL_INPUT_MAX)  break;
+  }
+  if (got < 0)  error = errno;
+
+  char *end;
+  while ((end = strstr(client->input->str, "\n\n")) != NULL) {
+    size_t length = (end - client->input->str) + 2;
+    end[1] = 0;
+    control_batch(client, client->input->str);
+    g_string_erase(client->input, 0, length);
+  }
+  if ( (got == 0) || ((got < 0) && (error != EAGAIN))
+      || (client->input->len > CONTROL_INPUT_MAX) ) {
+    close(fd);
+    g_string_free(client->input, TRUE);
+    free(client);
+    return G_SOURCE_REMOVE;
+  }
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+control_accept(gint fd, GIOCondition condition, gpointer data) {
+
+  (void)condition, (void)data;
+  int client_fd;
+  while ((client_fd = accept(fd, NULL, NULL)) >= 0) {
+    fcntl(client_fd, F_SETFL, O_NONBLOCK);
+    fcntl(client_fd, F_SETFD, FD_CLOEXEC);
+    LCIControlClient *client = calloc(1, sizeof(LCIControlClient));
+    client->fd = client_fd;
+    client->input = g_string_new(NULL);
+    client->source = g_unix_fd_add(client_fd, G_IO_IN, control_read, client);
+  }
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+control_init(void) {
+
+  const char *path = g_getenv("LCI_CONTROL");
+  struct sockaddr_un address = { AF_UNIX };
+  if ((path == NULL) || (*path == 0))  return;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    printf("ERROR: control socket path too long %s\n", path);
+    return;
+  }
+    // only a socket, a previous run's, is replaced
+  struct stat st;
+  if (lstat(path, &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      printf("ERROR: control socket path is not a socket %s\n", path);
+      return;
+    }
+    unlink(path);
+  }
+  strcpy(address.sun_path, path);
+  control_fd = socket(AF_UNIX, (SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC), 0);
+  mode_t mask = umask(0077);
+  int failed = (control_fd < 0)
+               || (bind(control_fd, (struct sockaddr *)&address,
+                                    sizeof(address)) != 0)
+               || (listen(control_fd, 8) != 0);
+  umask(mask);
+  if (failed) {
+    printf("ERROR: unable to open control socket %s\n", path);
+    if (control_fd >= 0)  close(control_fd);
+    control_fd = -1;
+    return;
+  }
+  control_path = strdup(path);
+  g_unix_fd_add(control_fd, G_IO_IN, control_accept, NULL);
+}
+
+static void
+control_close(void) {
+
+  if (control_fd < 0)  return;
+  close(control_fd);
+  unlink(control_path);
+  free(control_path);
+  control_fd = -1;
+}
+
+/* Single instance. With --single-instance, or LCI_SINGLE_INSTANCE
+ * set, first process owns SESSION_APP_ID on the session bus. Later
+ * launches hand it their command line and exit. Each becomes a new
+ * window of the resident process: an editor session, or the project
+ * of each path given.
+ */
+#define SESSION_APP_ID "org.lcode.Sessions"
+static GtkApplication *session_app;
+static int session_app_activated;
+
+static void
+session_app_startup(GApplication *app, gpointer data) {
+
+  (void)data;
+    // windows are not GtkApplicationWindow, session_main_quit() releases
+  g_application_hold(app);
+  session_start();
+}
+
+/* A launch arriving while quit is being written. Its session would
+ * end with this process, so a hold keeps application running past
+ * quit's release. One hold however many arrive, next quit releases it.
+ */
+static void
+session_app_revive(GApplication *app) {
+
+  if (session_quitting == 1) {
+    g_application_hold(app);
+    session_quitting = SESSION_QUIT_HELD;
+  }
+}
+
+static void
+session_app_activate(GApplication *app, gpointer data) {
+
+  (void)data;
+    // first activation is this process's own launch, restore did it
+  if (session_app_activated++ != 0) {
+    session_app_revive(app);
     lci_session_create(NULL);
   }
+}
+
+static void
+session_app_open(GApplication *app, GFile **files, gint n_files,
+                                   const gchar *hint, gpointer data) {
+
+  (void)hint;
+  (void)data;
+  if (session_app_activated++ != 0)
+    session_app_revive(app);
+  for (int idx = 0; idx < n_files; idx++) {
+    char *path = g_file_get_path(files[idx]);
+    if (path != NULL)
+      session_open_path(path);
+    g_free(path);
+  }
+}
+
+  // takes our flag off, gapplication would reject it
+static int
+session_app_wanted(int *argc, char **argv) {
+
+  const char *env = g_getenv("LCI_SINGLE_INSTANCE");
+  int wanted = ((env != NULL) && (*env != 0) && (strcmp(env, "0") != 0));
+  for (int idx = 1; idx < *argc; idx++) {
+    if (strcmp(argv[idx], "--single-instance") == 0) {
+      memmove(&argv[idx], &argv[(idx + 1)], (*argc - idx) * sizeof(char *));
+      (*argc)--;
+      wanted = 1;
+      break;
+    }
+  }
+  return wanted;
+}
+
+  // ends event tracker, whichever runs it
+static void
+session_main_quit(void) {
+
+  if (session_app != NULL)
+    g_application_release(G_APPLICATION(session_app));
+  else
+    gtk_main_quit();
+}
+
+int
+main(int argc, char *argv[]) {
+
+  trace_init(&argc, argv);
+
+  if (session_app_wanted(&argc, argv)) {
+    session_app = gtk_application_new(SESSION_APP_ID, G_APPLICATION_HANDLES_OPEN);
+    g_signal_connect(G_OBJECT(session_app), "startup",
+                                    G_CALLBACK(session_app_startup), NULL);
+    g_signal_connect(G_OBJECT(session_app), "activate",
+                                    G_CALLBACK(session_app_activate), NULL);
+    g_signal_connect(G_OBJECT(session_app), "open",
+                                    G_CALLBACK(session_app_open), NULL);
+    int status = g_application_run(G_APPLICATION(session_app), argc, argv);
+    g_object_unref(session_app);
+    control_close();
+    persist_wait();
+    project_index_wait();
+    trace_export();
+    return status;
+  }
+
+    // initialize gtk
+  gint64 start = trace_now();
+  gtk_init(&argc, &argv);
+  trace_span("gtk_init", start, NULL);
+
+  session_start();
 
     // run event tracker
   gtk_main();
 
+  control_close();
+  persist_wait();
+  project_index_wait();
+  trace_export();
   return 0;
 }
-